@@ -0,0 +1,67 @@
+// Creates batches of vectors, grows them to assorted sizes and destroys
+// them, allocating through glibc, an arena reset after every batch and a
+// size class pool.
+
+#include "bench.h"
+
+#define ROUNDS 2000u
+#define VECTORS_PER_ROUND 64u
+
+typedef enum allocator_kind { use_glibc, use_arena, use_pool } allocator_kind;
+
+static uint64_t churn(allocator_kind kind) {
+  cvector_arena* arena = cvector_arena_create(0, NULL);
+  cvector_pool* pool = cvector_pool_create(NULL);
+  cvector_memmgmt_procs_t procs;
+  cvector_memmgmt_procs_t* mp = NULL;
+  if (kind == use_arena) {
+    procs = cvector_arena_procs(arena);
+    mp = &procs;
+  } else if (kind == use_pool) {
+    procs = cvector_pool_procs(pool);
+    mp = &procs;
+  }
+
+  uint64_t state = 88172645463325252ull;
+  uint64_t sum = 0;
+  cvector* vectors[VECTORS_PER_ROUND];
+  for (uint32_t r = 0; r < ROUNDS; ++r) {
+    for (uint32_t i = 0; i < VECTORS_PER_ROUND; ++i) {
+      state ^= state << 13;
+      state ^= state >> 7;
+      state ^= state << 17;
+      uint32_t count = 4u << (state % 8);
+      vectors[i] = cvector_create_mp(sizeof(uint32_t), mp, NULL);
+      for (uint32_t k = 0; k < count; ++k) {
+        cvector_push_back(vectors[i], &k);
+      }
+      sum += cvector_elem_count64(vectors[i]);
+    }
+    for (uint32_t i = 0; i < VECTORS_PER_ROUND; ++i) {
+      cvector_destroy(vectors[i]);
+    }
+    cvector_arena_reset(arena);
+  }
+
+  cvector_pool_destroy(pool);
+  cvector_arena_destroy(arena);
+  return sum;
+}
+
+int main(void) {
+  printf("%-10s %10s\n", "allocator", "ms");
+
+  const char* names[] = {"glibc", "arena", "pool"};
+  uint64_t expected = 0;
+  for (int kind = use_glibc; kind <= use_pool; ++kind) {
+    uint64_t start = bench_now_ns();
+    uint64_t sum = churn(kind);
+    printf("%-10s %10.1f\n", names[kind], (bench_now_ns() - start) / 1e6);
+    if (expected && sum != expected) {
+      return 1;
+    }
+    expected = sum;
+  }
+
+  return 0;
+}
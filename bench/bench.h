@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cvector.h>
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static inline uint64_t bench_now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// Memory management procs keeping track of the live and the peak number
+// of bytes handed out through them.
+static size_t bench_live_bytes = 0;
+static size_t bench_peak_bytes = 0;
+
+static inline void bench_account(void* ptr, long sign) {
+  if (ptr) {
+    bench_live_bytes += sign * (long)malloc_usable_size(ptr);
+    if (bench_live_bytes > bench_peak_bytes) {
+      bench_peak_bytes = bench_live_bytes;
+    }
+  }
+}
+
+static inline void* bench_malloc(size_t size) {
+  void* ptr = malloc(size);
+  bench_account(ptr, 1);
+  return ptr;
+}
+
+static inline void* bench_calloc(size_t elem_count, size_t elem_size) {
+  void* ptr = calloc(elem_count, elem_size);
+  bench_account(ptr, 1);
+  return ptr;
+}
+
+static inline void* bench_realloc(void* ptr, size_t size) {
+  size_t old_size = ptr ? malloc_usable_size(ptr) : 0;
+  void* new_ptr = realloc(ptr, size);
+  if (new_ptr) {
+    bench_live_bytes -= old_size;
+    bench_account(new_ptr, 1);
+  }
+  return new_ptr;
+}
+
+static inline void bench_free(void* ptr) {
+  bench_account(ptr, -1);
+  free(ptr);
+}
+
+static inline void bench_reset_memory_stats(void) {
+  bench_live_bytes = 0;
+  bench_peak_bytes = 0;
+}
+
+static __attribute__((unused))
+cvector_memmgmt_procs_t bench_counting_procs = {.malloc = bench_malloc,
+                                                .free = bench_free,
+                                                .calloc = bench_calloc,
+                                                .realloc = bench_realloc};
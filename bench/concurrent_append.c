@@ -0,0 +1,74 @@
+// Compares threads appending to a cvector_concurrent with the same threads
+// appending to a cvector behind a mutex.
+
+#include <pthread.h>
+
+#include "bench.h"
+
+#define ELEM_COUNT (16u * 1024 * 1024)
+#define MAX_THREADS 32
+
+typedef struct producer {
+  pthread_t thread;
+  uint64_t count;
+  cvector* v;
+  pthread_mutex_t* lock;
+  cvector_concurrent* cv;
+} producer;
+
+static void* push_locked(void* arg) {
+  producer* p = arg;
+  for (uint64_t i = 0; i < p->count; ++i) {
+    pthread_mutex_lock(p->lock);
+    cvector_push_back(p->v, &i);
+    pthread_mutex_unlock(p->lock);
+  }
+  return NULL;
+}
+
+static void* push_concurrent(void* arg) {
+  producer* p = arg;
+  for (uint64_t i = 0; i < p->count; ++i) {
+    cvector_concurrent_push_back(p->cv, &i, NULL);
+  }
+  return NULL;
+}
+
+static double run(uint32_t threads, void* (*body)(void*), cvector* v,
+                  pthread_mutex_t* lock, cvector_concurrent* cv) {
+  producer producers[MAX_THREADS];
+  uint64_t start = bench_now_ns();
+  for (uint32_t t = 0; t < threads; ++t) {
+    producers[t] = (producer){
+        .count = ELEM_COUNT / threads, .v = v, .lock = lock, .cv = cv};
+    pthread_create(&producers[t].thread, NULL, body, &producers[t]);
+  }
+  for (uint32_t t = 0; t < threads; ++t) {
+    pthread_join(producers[t].thread, NULL);
+  }
+  return (bench_now_ns() - start) / 1e6;
+}
+
+int main(void) {
+  printf("%-10s %12s %12s %12s\n", "threads", "mutex ms", "atomic ms",
+         "Mpush/s");
+  for (uint32_t threads = 1; threads <= MAX_THREADS; threads *= 2) {
+    pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+    cvector* v = cvector_create(sizeof(uint64_t), NULL);
+    double locked_ms = run(threads, push_locked, v, &lock, NULL);
+    cvector_destroy(v);
+
+    cvector_concurrent* cv =
+        cvector_concurrent_create(sizeof(uint64_t), NULL, NULL);
+    double concurrent_ms = run(threads, push_concurrent, NULL, NULL, cv);
+    if (cvector_concurrent_elem_count(cv) !=
+        ELEM_COUNT / threads * threads) {
+      return 1;
+    }
+    cvector_concurrent_destroy(cv);
+
+    printf("%-10u %12.1f %12.1f %12.1f\n", threads, locked_ms, concurrent_ms,
+           ELEM_COUNT / concurrent_ms / 1e3);
+  }
+  return 0;
+}
@@ -0,0 +1,52 @@
+// Removes every fifth element, once with repeated cvector_erase_range
+// calls and once with a single cvector_erase_if pass.
+
+#include "bench.h"
+
+#define SMALL_COUNT 100000u
+#define LARGE_COUNT 5000000u
+
+static bool is_expired(const void* elem, void* args) {
+  (void)args;
+  return *(const uint64_t*)elem % 5 == 0;
+}
+
+static cvector* make_vector(uint64_t count) {
+  cvector* v = cvector_create(sizeof(uint64_t), NULL);
+  cvector_reserve64(v, count);
+  for (uint64_t i = 0; i < count; ++i) {
+    cvector_push_back(v, &i);
+  }
+  return v;
+}
+
+int main(void) {
+  printf("%-12s %10s %10s\n", "method", "elements", "ms");
+
+  cvector* v = make_vector(SMALL_COUNT);
+  uint64_t start = bench_now_ns();
+  for (uint64_t i = 0; i < cvector_elem_count64(v);) {
+    uint64_t* elem;
+    cvector_get_ptr_at64(v, i, (void**)&elem);
+    if (is_expired(elem, NULL)) {
+      cvector_erase_range(v, i, i + 1);
+    } else {
+      ++i;
+    }
+  }
+  printf("%-12s %10u %10.1f\n", "erase_range", SMALL_COUNT,
+         (bench_now_ns() - start) / 1e6);
+  cvector_destroy(v);
+
+  uint64_t counts[] = {SMALL_COUNT, LARGE_COUNT};
+  for (int i = 0; i < 2; ++i) {
+    v = make_vector(counts[i]);
+    start = bench_now_ns();
+    cvector_erase_if(v, is_expired, NULL);
+    printf("%-12s %10lu %10.1f\n", "erase_if", counts[i],
+           (bench_now_ns() - start) / 1e6);
+    cvector_destroy(v);
+  }
+
+  return 0;
+}
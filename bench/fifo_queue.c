@@ -0,0 +1,45 @@
+// Runs a work queue holding a steady backlog of elements, taking from the
+// front with cvector_erase_range on a plain vector and with
+// cvector_pop_front on a deque.
+
+#include "bench.h"
+
+#define OPERATIONS 200000u
+
+static double run_queue(cvector* v, uint64_t backlog, bool deque) {
+  for (uint64_t i = 0; i < backlog; ++i) {
+    cvector_push_back(v, &i);
+  }
+  uint64_t start = bench_now_ns();
+  uint64_t elem;
+  for (uint64_t i = 0; i < OPERATIONS; ++i) {
+    cvector_push_back(v, &i);
+    if (deque) {
+      cvector_pop_front(v, &elem);
+    } else {
+      cvector_get_copy_at64(v, 0, &elem);
+      cvector_erase_range(v, 0, 1);
+    }
+  }
+  return (bench_now_ns() - start) / 1e6;
+}
+
+int main(void) {
+  printf("%-12s %10s %10s\n", "method", "backlog", "ms");
+
+  uint64_t backlogs[] = {16, 1024, 65536};
+  for (int i = 0; i < 3; ++i) {
+    cvector* v = cvector_create(sizeof(uint64_t), NULL);
+    printf("%-12s %10lu %10.1f\n", "erase_range", backlogs[i],
+           run_queue(v, backlogs[i], false));
+    cvector_destroy(v);
+
+    v = cvector_create_opts(sizeof(uint64_t),
+                            &(cvector_create_opts_t){.deque = true}, NULL);
+    printf("%-12s %10lu %10.1f\n", "pop_front", backlogs[i],
+           run_queue(v, backlogs[i], true));
+    cvector_destroy(v);
+  }
+
+  return 0;
+}
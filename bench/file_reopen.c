@@ -0,0 +1,49 @@
+// Compares rebuilding a large vector at startup with reopening the file
+// backed vector holding it.
+
+#include <unistd.h>
+
+#include "bench.h"
+
+#define ELEM_COUNT (64u * 1024 * 1024)
+
+static void fill(cvector* v) {
+  for (uint32_t i = 0; i < ELEM_COUNT; ++i) {
+    cvector_push_back(v, &i);
+  }
+}
+
+int main(void) {
+  const char* path = "file_reopen.cvec";
+  printf("%-10s %10s\n", "method", "ms");
+
+  uint64_t start = bench_now_ns();
+  cvector* v = cvector_create(sizeof(uint32_t), NULL);
+  fill(v);
+  printf("%-10s %10.1f\n", "rebuild", (bench_now_ns() - start) / 1e6);
+  cvector_destroy(v);
+
+  v = cvector_open_file(path, sizeof(uint32_t),
+                        cvec_file_create | cvec_file_truncate, NULL);
+  if (!v) {
+    return 1;
+  }
+  start = bench_now_ns();
+  fill(v);
+  cvector_sync(v);
+  printf("%-10s %10.1f\n", "write", (bench_now_ns() - start) / 1e6);
+  cvector_destroy(v);
+
+  start = bench_now_ns();
+  v = cvector_open_file(path, sizeof(uint32_t), 0, NULL);
+  printf("%-10s %10.1f\n", "reopen", (bench_now_ns() - start) / 1e6);
+
+  start = bench_now_ns();
+  int64_t sum = 0;
+  cvector_sum_i32(v, &sum);
+  printf("%-10s %10.1f\n", "first scan", (bench_now_ns() - start) / 1e6);
+  cvector_destroy(v);
+
+  unlink(path);
+  return sum == 0;
+}
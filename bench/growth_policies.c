@@ -0,0 +1,58 @@
+// Compares the growth policies on push_back throughput and on the peak
+// amount of memory held while a vector is being filled.
+
+#include "bench.h"
+
+#define ELEM_COUNT 20000000u
+#define ROUNDS 5
+
+static const struct {
+  const char* name;
+  cvector_growth_kind_t kind;
+} policies[] = {{"double", cvec_growth_double},
+                {"one_and_half", cvec_growth_one_and_half},
+                {"golden_ratio", cvec_growth_golden_ratio},
+                {"page", cvec_growth_page}};
+
+int main(void) {
+  printf("%-14s %12s %12s %14s\n", "policy", "Mpush/s", "peak MiB",
+         "final cap");
+
+  for (size_t p = 0; p < sizeof(policies) / sizeof(policies[0]); ++p) {
+    uint64_t best_ns = UINT64_MAX;
+    size_t peak = 0;
+    uint32_t capacity = 0;
+
+    for (int r = 0; r < ROUNDS; ++r) {
+      bench_reset_memory_stats();
+      cvector* v = cvector_create_opts(
+          sizeof(uint64_t),
+          &(cvector_create_opts_t){
+              .mmgmt_procs = &bench_counting_procs,
+              .growth_policy = {.kind = policies[p].kind}},
+          NULL);
+      if (!v) {
+        fprintf(stderr, "failed to create a vector\n");
+        return 1;
+      }
+
+      uint64_t start = bench_now_ns();
+      for (uint64_t i = 0; i < ELEM_COUNT; ++i) {
+        cvector_push_back(v, &i);
+      }
+      uint64_t elapsed = bench_now_ns() - start;
+
+      if (elapsed < best_ns) {
+        best_ns = elapsed;
+      }
+      peak = bench_peak_bytes;
+      capacity = cvector_capacity(v);
+      cvector_destroy(v);
+    }
+
+    printf("%-14s %12.1f %12.1f %14u\n", policies[p].name,
+           ELEM_COUNT / (best_ns / 1e3), peak / (1024.0 * 1024.0), capacity);
+  }
+
+  return 0;
+}
@@ -0,0 +1,103 @@
+// Compares the SIMD kernels on every instruction set the CPU supports
+// against reducing the same vectors through cvector_exec_for_each64.
+
+#include "bench.h"
+
+#define ELEM_COUNT 8000000u
+#define ROUNDS 10
+
+static const char* level_names[] = {"scalar", "sse2", "avx2", "avx512"};
+
+static cvector* doubles;
+static cvector* ints;
+
+static void add_double(uint64_t index, void* elem, void* args) {
+  (void)index;
+  *(double*)args += *(double*)elem;
+}
+
+static void add_int32(uint64_t index, void* elem, void* args) {
+  (void)index;
+  *(int64_t*)args += *(int32_t*)elem;
+}
+
+static void callback_sum_f64(void) {
+  double sum = 0;
+  cvector_exec_for_each64(doubles, add_double, &sum);
+  __asm__ volatile("" : : "r"(&sum) : "memory");
+}
+
+static void callback_sum_i32(void) {
+  int64_t sum = 0;
+  cvector_exec_for_each64(ints, add_int32, &sum);
+  __asm__ volatile("" : : "r"(&sum) : "memory");
+}
+
+static void kernel_sum_f64(void) {
+  double sum = 0;
+  cvector_sum_f64(doubles, &sum);
+  __asm__ volatile("" : : "r"(&sum) : "memory");
+}
+
+static void kernel_sum_i32(void) {
+  int64_t sum = 0;
+  cvector_sum_i32(ints, &sum);
+  __asm__ volatile("" : : "r"(&sum) : "memory");
+}
+
+static void kernel_dot_f64(void) {
+  double dot = 0;
+  cvector_dot_f64(doubles, doubles, &dot);
+  __asm__ volatile("" : : "r"(&dot) : "memory");
+}
+
+static void kernel_minmax_i32(void) {
+  int32_t min, max;
+  cvector_minmax_i32(ints, &min, &max);
+  __asm__ volatile("" : : "r"(&min), "r"(&max) : "memory");
+}
+
+static void report(const char* name, const char* level, void (*op)(void)) {
+  uint64_t best_ns = UINT64_MAX;
+  for (int r = 0; r < ROUNDS; ++r) {
+    uint64_t start = bench_now_ns();
+    op();
+    uint64_t elapsed = bench_now_ns() - start;
+    if (elapsed < best_ns) {
+      best_ns = elapsed;
+    }
+  }
+  printf("%-14s %-10s %12.1f\n", name, level, ELEM_COUNT / (best_ns / 1e3));
+}
+
+int main(void) {
+  doubles = cvector_create(sizeof(double), NULL);
+  ints = cvector_create(sizeof(int32_t), NULL);
+  cvector_reserve64(doubles, ELEM_COUNT);
+  cvector_reserve64(ints, ELEM_COUNT);
+  for (uint32_t i = 0; i < ELEM_COUNT; ++i) {
+    double d = i * 0.5;
+    int32_t n = (int32_t)(i * 2654435761u);
+    cvector_push_back(doubles, &d);
+    cvector_push_back(ints, &n);
+  }
+
+  printf("%-14s %-10s %12s\n", "operation", "path", "Melem/s");
+  report("sum_f64", "callback", callback_sum_f64);
+  report("sum_i32", "callback", callback_sum_i32);
+
+  cvector_simd_level_t detected = cvector_simd_level();
+  for (int level = cvec_simd_scalar; level <= (int)detected; ++level) {
+    if (cvector_set_simd_level((cvector_simd_level_t)level) != cvec_success) {
+      continue;
+    }
+    report("sum_f64", level_names[level], kernel_sum_f64);
+    report("sum_i32", level_names[level], kernel_sum_i32);
+    report("dot_f64", level_names[level], kernel_dot_f64);
+    report("minmax_i32", level_names[level], kernel_minmax_i32);
+  }
+
+  cvector_destroy(doubles);
+  cvector_destroy(ints);
+  return 0;
+}
@@ -0,0 +1,47 @@
+// Grows a large vector in chunks and scans it, with heap storage, mapped
+// storage and mapped storage on transparent huge pages.
+
+#include "bench.h"
+
+#define ELEM_COUNT (128u * 1024 * 1024)
+#define CHUNK 65536u
+
+int main(void) {
+  printf("%-10s %10s %10s\n", "storage", "grow ms", "scan ms");
+
+  uint32_t* chunk = malloc(CHUNK * sizeof(uint32_t));
+  for (uint32_t i = 0; i < CHUNK; ++i) {
+    chunk[i] = i;
+  }
+
+  struct {
+    const char* name;
+    cvector_create_opts_t opts;
+  } configs[] = {
+      {"heap", {0}},
+      {"mmap", {.mmap_threshold = 1024 * 1024}},
+      {"mmap+thp", {.mmap_threshold = 1024 * 1024, .huge_pages = true}},
+  };
+
+  for (int c = 0; c < 3; ++c) {
+    cvector* v = cvector_create_opts(sizeof(uint32_t), &configs[c].opts, NULL);
+    uint64_t start = bench_now_ns();
+    for (uint32_t i = 0; i < ELEM_COUNT / CHUNK; ++i) {
+      cvector_push_back_n(v, chunk, CHUNK);
+    }
+    double grow_ms = (bench_now_ns() - start) / 1e6;
+
+    start = bench_now_ns();
+    int64_t sum = 0;
+    cvector_sum_i32(v, &sum);
+    double scan_ms = (bench_now_ns() - start) / 1e6;
+    printf("%-10s %10.1f %10.1f\n", configs[c].name, grow_ms, scan_ms);
+    if (sum == 0) {
+      return 1;
+    }
+    cvector_destroy(v);
+  }
+
+  free(chunk);
+  return 0;
+}
@@ -0,0 +1,64 @@
+// Shows how cvector_exec_for_each_parallel scales from one thread up to
+// the number of online CPUs, against the sequential cvector_exec_for_each64.
+
+#include <math.h>
+#include <unistd.h>
+
+#include "bench.h"
+
+#define ELEM_COUNT 10000000u
+#define ROUNDS 3
+
+static void score(uint64_t index, void* elem, void* args) {
+  (void)index;
+  (void)args;
+  double* d = (double*)elem;
+  *d = sqrt(*d * 1.0001 + 1.0) * 0.5;
+}
+
+static uint64_t best_of(cvector* v, cvector_thread_pool* pool) {
+  uint64_t best_ns = UINT64_MAX;
+  for (int r = 0; r < ROUNDS; ++r) {
+    uint64_t start = bench_now_ns();
+    if (pool) {
+      cvector_exec_for_each_parallel(v, score, NULL, pool, 0);
+    } else {
+      cvector_exec_for_each64(v, score, NULL);
+    }
+    uint64_t elapsed = bench_now_ns() - start;
+    if (elapsed < best_ns) {
+      best_ns = elapsed;
+    }
+  }
+  return best_ns;
+}
+
+int main(void) {
+  cvector* v = cvector_create(sizeof(double), NULL);
+  cvector_reserve64(v, ELEM_COUNT);
+  for (uint64_t i = 0; i < ELEM_COUNT; ++i) {
+    double d = (double)i;
+    cvector_push_back(v, &d);
+  }
+
+  uint64_t sequential_ns = best_of(v, NULL);
+  printf("%-10s %10s %10s\n", "threads", "ms", "speedup");
+  printf("%-10s %10.2f %10.2f\n", "seq", sequential_ns / 1e6, 1.0);
+
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  for (uint32_t threads = 1; threads <= (uint32_t)cpus; threads *= 2) {
+    cvector_thread_pool* pool = cvector_thread_pool_create(threads, NULL);
+    if (!pool) {
+      fprintf(stderr, "failed to create a thread pool\n");
+      return 1;
+    }
+
+    uint64_t ns = best_of(v, pool);
+    printf("%-10u %10.2f %10.2f\n", threads, ns / 1e6,
+           (double)sequential_ns / ns);
+    cvector_thread_pool_destroy(pool);
+  }
+
+  cvector_destroy(v);
+  return 0;
+}
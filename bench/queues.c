@@ -0,0 +1,263 @@
+// Passes messages between threads through a cvector deque behind a mutex
+// and two condition variables, a cvector_spsc_queue and a
+// cvector_mpmc_queue. Measures the throughput of producers and consumers
+// moving messages one at a time and in batches, and the round trip latency
+// of two threads bouncing a message back and forth. The lock free queues
+// never block, their callers yield while the queue is full or empty.
+
+#include <pthread.h>
+#include <sched.h>
+
+#include "bench.h"
+
+#define MESSAGE_COUNT (4u * 1024 * 1024)
+#define QUEUE_CAPACITY 1024
+#define ROUND_TRIPS 100000
+#define MAX_THREADS 4
+
+typedef struct locked_queue {
+  cvector* v;
+  pthread_mutex_t lock;
+  pthread_cond_t not_empty;
+  pthread_cond_t not_full;
+} locked_queue;
+
+typedef struct queue_kind {
+  const char* name;
+  void* (*create)(void);
+  void (*destroy)(void* q);
+  // Both block until they move at least one message and return how many
+  // they moved.
+  uint64_t (*enqueue)(void* q, const uint64_t* msgs, uint64_t count);
+  uint64_t (*dequeue)(void* q, uint64_t* msgs, uint64_t count);
+} queue_kind;
+
+static void* locked_create(void) {
+  locked_queue* q = malloc(sizeof(locked_queue));
+  q->v = cvector_create_opts(sizeof(uint64_t),
+                             &(cvector_create_opts_t){.deque = true}, NULL);
+  cvector_reserve64(q->v, QUEUE_CAPACITY);
+  pthread_mutex_init(&q->lock, NULL);
+  pthread_cond_init(&q->not_empty, NULL);
+  pthread_cond_init(&q->not_full, NULL);
+  return q;
+}
+
+static void locked_destroy(void* arg) {
+  locked_queue* q = arg;
+  cvector_destroy(q->v);
+  pthread_mutex_destroy(&q->lock);
+  pthread_cond_destroy(&q->not_empty);
+  pthread_cond_destroy(&q->not_full);
+  free(q);
+}
+
+static uint64_t locked_enqueue(void* arg, const uint64_t* msgs,
+                               uint64_t count) {
+  locked_queue* q = arg;
+  pthread_mutex_lock(&q->lock);
+  uint64_t room;
+  while ((room = QUEUE_CAPACITY - cvector_elem_count64(q->v)) == 0) {
+    pthread_cond_wait(&q->not_full, &q->lock);
+  }
+  uint64_t n = room < count ? room : count;
+  cvector_push_back_n64(q->v, msgs, n);
+  pthread_cond_broadcast(&q->not_empty);
+  pthread_mutex_unlock(&q->lock);
+  return n;
+}
+
+static uint64_t locked_dequeue(void* arg, uint64_t* msgs, uint64_t count) {
+  locked_queue* q = arg;
+  pthread_mutex_lock(&q->lock);
+  while (cvector_elem_count64(q->v) == 0) {
+    pthread_cond_wait(&q->not_empty, &q->lock);
+  }
+  uint64_t n = 0;
+  while (n < count && cvector_pop_front(q->v, &msgs[n]) == cvec_success) {
+    ++n;
+  }
+  pthread_cond_broadcast(&q->not_full);
+  pthread_mutex_unlock(&q->lock);
+  return n;
+}
+
+static void* spsc_create(void) {
+  return cvector_spsc_queue_create(sizeof(uint64_t), QUEUE_CAPACITY, NULL,
+                                   NULL);
+}
+
+static void spsc_destroy(void* q) { __cvector_spsc_queue_destroy(q); }
+
+static uint64_t spsc_enqueue(void* q, const uint64_t* msgs, uint64_t count) {
+  uint64_t n;
+  while (cvector_spsc_queue_enqueue_n(q, msgs, count, &n) != cvec_success) {
+    sched_yield();
+  }
+  return n;
+}
+
+static uint64_t spsc_dequeue(void* q, uint64_t* msgs, uint64_t count) {
+  uint64_t n;
+  while (cvector_spsc_queue_dequeue_n(q, msgs, count, &n) != cvec_success) {
+    sched_yield();
+  }
+  return n;
+}
+
+static void* mpmc_create(void) {
+  return cvector_mpmc_queue_create(sizeof(uint64_t), QUEUE_CAPACITY, NULL,
+                                   NULL);
+}
+
+static void mpmc_destroy(void* q) { __cvector_mpmc_queue_destroy(q); }
+
+static uint64_t mpmc_enqueue(void* q, const uint64_t* msgs, uint64_t count) {
+  uint64_t n;
+  while (cvector_mpmc_queue_enqueue_n(q, msgs, count, &n) != cvec_success) {
+    sched_yield();
+  }
+  return n;
+}
+
+static uint64_t mpmc_dequeue(void* q, uint64_t* msgs, uint64_t count) {
+  uint64_t n;
+  while (cvector_mpmc_queue_dequeue_n(q, msgs, count, &n) != cvec_success) {
+    sched_yield();
+  }
+  return n;
+}
+
+static const queue_kind locked_kind = {"mutex", locked_create,
+                                       locked_destroy, locked_enqueue,
+                                       locked_dequeue};
+static const queue_kind spsc_kind = {"spsc", spsc_create, spsc_destroy,
+                                     spsc_enqueue, spsc_dequeue};
+static const queue_kind mpmc_kind = {"mpmc", mpmc_create, mpmc_destroy,
+                                     mpmc_enqueue, mpmc_dequeue};
+
+typedef struct worker {
+  pthread_t thread;
+  const queue_kind* kind;
+  void* q;
+  uint64_t count;
+  uint64_t batch;
+  uint64_t checksum;
+} worker;
+
+static void* produce(void* arg) {
+  worker* w = arg;
+  uint64_t msgs[64];
+  for (uint64_t i = 0; i < w->count;) {
+    uint64_t n = w->count - i < w->batch ? w->count - i : w->batch;
+    for (uint64_t j = 0; j < n; ++j) {
+      msgs[j] = i + j;
+    }
+    uint64_t sent = 0;
+    while (sent < n) {
+      sent += w->kind->enqueue(w->q, msgs + sent, n - sent);
+    }
+    i += n;
+  }
+  return NULL;
+}
+
+// Every consumer takes an equal share, so none of them waits for messages
+// that some other consumer already took.
+static void* consume(void* arg) {
+  worker* w = arg;
+  uint64_t msgs[64];
+  for (uint64_t i = 0; i < w->count;) {
+    uint64_t n = w->count - i < w->batch ? w->count - i : w->batch;
+    n = w->kind->dequeue(w->q, msgs, n);
+    for (uint64_t j = 0; j < n; ++j) {
+      w->checksum += msgs[j];
+    }
+    i += n;
+  }
+  return NULL;
+}
+
+static void throughput(const queue_kind* kind, uint32_t threads,
+                       uint64_t batch) {
+  void* q = kind->create();
+  worker workers[2 * MAX_THREADS];
+  uint64_t start = bench_now_ns();
+  for (uint32_t t = 0; t < 2 * threads; ++t) {
+    workers[t] = (worker){.kind = kind,
+                          .q = q,
+                          .count = MESSAGE_COUNT / threads,
+                          .batch = batch};
+    pthread_create(&workers[t].thread, NULL, t < threads ? produce : consume,
+                   &workers[t]);
+  }
+  uint64_t checksum = 0;
+  for (uint32_t t = 0; t < 2 * threads; ++t) {
+    pthread_join(workers[t].thread, NULL);
+    checksum += workers[t].checksum;
+  }
+  double ms = (bench_now_ns() - start) / 1e6;
+  uint64_t per_thread = MESSAGE_COUNT / threads;
+  if (checksum != threads * (per_thread * (per_thread - 1) / 2)) {
+    exit(1);
+  }
+  kind->destroy(q);
+
+  printf("%-8s %4u:%-4u %6lu %12.1f %12.1f\n", kind->name, threads, threads,
+         batch, ms, MESSAGE_COUNT / ms / 1e3);
+}
+
+typedef struct ping_pong {
+  const queue_kind* kind;
+  void* ping;
+  void* pong;
+} ping_pong;
+
+static void* bounce(void* arg) {
+  ping_pong* p = arg;
+  uint64_t msg;
+  for (uint64_t i = 0; i < ROUND_TRIPS; ++i) {
+    p->kind->dequeue(p->ping, &msg, 1);
+    p->kind->enqueue(p->pong, &msg, 1);
+  }
+  return NULL;
+}
+
+static void latency(const queue_kind* kind) {
+  ping_pong p = {kind, kind->create(), kind->create()};
+  pthread_t thread;
+  pthread_create(&thread, NULL, bounce, &p);
+  uint64_t start = bench_now_ns();
+  for (uint64_t i = 0; i < ROUND_TRIPS; ++i) {
+    uint64_t msg = i;
+    kind->enqueue(p.ping, &msg, 1);
+    kind->dequeue(p.pong, &msg, 1);
+  }
+  double ns = (double)(bench_now_ns() - start) / ROUND_TRIPS;
+  pthread_join(thread, NULL);
+  kind->destroy(p.ping);
+  kind->destroy(p.pong);
+
+  printf("%-8s %12.0f\n", kind->name, ns);
+}
+
+int main(void) {
+  printf("%-8s %9s %6s %12s %12s\n", "queue", "threads", "batch", "ms",
+         "Mmsg/s");
+  uint64_t batches[] = {1, 32};
+  for (int b = 0; b < 2; ++b) {
+    throughput(&locked_kind, 1, batches[b]);
+    throughput(&spsc_kind, 1, batches[b]);
+    throughput(&mpmc_kind, 1, batches[b]);
+  }
+  for (int b = 0; b < 2; ++b) {
+    throughput(&locked_kind, MAX_THREADS, batches[b]);
+    throughput(&mpmc_kind, MAX_THREADS, batches[b]);
+  }
+
+  printf("\n%-8s %12s\n", "queue", "round trip ns");
+  latency(&locked_kind);
+  latency(&spsc_kind);
+  latency(&mpmc_kind);
+  return 0;
+}
@@ -0,0 +1,96 @@
+// Looks up random keys in a large sorted table with bsearch,
+// cvector_lower_bound, cvector_lower_bound_by_key and the batched variant.
+
+#include <string.h>
+
+#include "bench.h"
+
+#define ELEM_COUNT 8000000u
+#define QUERY_COUNT 2000000u
+
+typedef struct record {
+  uint64_t key;
+  uint64_t value;
+} record;
+
+static int compare_key_to_record(const void* key, const void* elem) {
+  uint64_t x = *(const uint64_t*)key;
+  uint64_t y = ((const record*)elem)->key;
+  return (x > y) - (x < y);
+}
+
+static int compare_keys(const void* a, const void* b) {
+  uint64_t x = *(const uint64_t*)a;
+  uint64_t y = *(const uint64_t*)b;
+  return (x > y) - (x < y);
+}
+
+int main(void) {
+  cvector* v = cvector_create(sizeof(record), NULL);
+  cvector_reserve64(v, ELEM_COUNT);
+  for (uint64_t i = 0; i < ELEM_COUNT; ++i) {
+    record r = {.key = i * 3, .value = i};
+    cvector_push_back(v, &r);
+  }
+  record* data = NULL;
+  cvector_get_ptr_at(v, 0, (void**)&data);
+
+  uint64_t* keys = malloc(QUERY_COUNT * sizeof(uint64_t));
+  uint64_t* indexes = malloc(QUERY_COUNT * sizeof(uint64_t));
+  uint64_t state = 88172645463325252ull;
+  for (uint64_t i = 0; i < QUERY_COUNT; ++i) {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    keys[i] = state % (ELEM_COUNT * 3ull);
+  }
+
+  printf("%-16s %10s %10s\n", "method", "ms", "found");
+
+  uint64_t found = 0;
+  uint64_t start = bench_now_ns();
+  for (uint64_t i = 0; i < QUERY_COUNT; ++i) {
+    found += bsearch(&keys[i], data, ELEM_COUNT, sizeof(record),
+                     compare_key_to_record) != NULL;
+  }
+  printf("%-16s %10.1f %10lu\n", "bsearch", (bench_now_ns() - start) / 1e6,
+         found);
+
+  found = 0;
+  start = bench_now_ns();
+  for (uint64_t i = 0; i < QUERY_COUNT; ++i) {
+    uint64_t index;
+    cvector_lower_bound(v, &keys[i], compare_key_to_record, &index);
+    found += index < ELEM_COUNT && data[index].key == keys[i];
+  }
+  printf("%-16s %10.1f %10lu\n", "lower_bound", (bench_now_ns() - start) / 1e6,
+         found);
+
+  found = 0;
+  start = bench_now_ns();
+  for (uint64_t i = 0; i < QUERY_COUNT; ++i) {
+    uint64_t index;
+    cvector_lower_bound_by_key(v, offsetof(record, key), sizeof(uint64_t),
+                               keys[i], &index);
+    found += index < ELEM_COUNT && data[index].key == keys[i];
+  }
+  printf("%-16s %10.1f %10lu\n", "lower_bound_key",
+         (bench_now_ns() - start) / 1e6, found);
+
+  // The batch needs its queries sorted, which is part of its cost.
+  found = 0;
+  start = bench_now_ns();
+  qsort(keys, QUERY_COUNT, sizeof(uint64_t), compare_keys);
+  cvector_lower_bound_batch_by_key(v, offsetof(record, key), sizeof(uint64_t),
+                                   keys, QUERY_COUNT, indexes);
+  for (uint64_t i = 0; i < QUERY_COUNT; ++i) {
+    found += indexes[i] < ELEM_COUNT && data[indexes[i]].key == keys[i];
+  }
+  printf("%-16s %10.1f %10lu\n", "batch_by_key",
+         (bench_now_ns() - start) / 1e6, found);
+
+  free(indexes);
+  free(keys);
+  cvector_destroy(v);
+  return 0;
+}
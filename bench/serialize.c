@@ -0,0 +1,76 @@
+// Compares saving and loading a large vector element by element through
+// stdio with cvector_write_fd and cvector_read_fd.
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "bench.h"
+
+#define ELEM_COUNT (64u * 1024 * 1024)
+
+int main(void) {
+  const char* path = "serialize.cvec";
+  printf("%-10s %10s %10s\n", "method", "write ms", "read ms");
+
+  cvector* v = cvector_create(sizeof(uint32_t), NULL);
+  for (uint32_t i = 0; i < ELEM_COUNT; ++i) {
+    cvector_push_back(v, &i);
+  }
+
+  uint64_t start = bench_now_ns();
+  FILE* f = fopen(path, "wb");
+  if (!f) {
+    return 1;
+  }
+  uint64_t count = cvector_elem_count64(v);
+  fwrite(&count, sizeof(count), 1, f);
+  for (uint64_t i = 0; i < count; ++i) {
+    uint32_t val;
+    cvector_get_copy_at(v, i, &val);
+    fwrite(&val, sizeof(val), 1, f);
+  }
+  fclose(f);
+  double write_ms = (bench_now_ns() - start) / 1e6;
+
+  start = bench_now_ns();
+  f = fopen(path, "rb");
+  cvector* copy = cvector_create(sizeof(uint32_t), NULL);
+  if (fread(&count, sizeof(count), 1, f) != 1) {
+    return 1;
+  }
+  for (uint64_t i = 0; i < count; ++i) {
+    uint32_t val;
+    if (fread(&val, sizeof(val), 1, f) != 1) {
+      return 1;
+    }
+    cvector_push_back(copy, &val);
+  }
+  fclose(f);
+  printf("%-10s %10.1f %10.1f\n", "stdio", write_ms,
+         (bench_now_ns() - start) / 1e6);
+  cvector_destroy(copy);
+
+  start = bench_now_ns();
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0 || cvector_write_fd(v, fd) != cvec_success) {
+    return 1;
+  }
+  close(fd);
+  write_ms = (bench_now_ns() - start) / 1e6;
+
+  start = bench_now_ns();
+  fd = open(path, O_RDONLY);
+  copy = cvector_create(sizeof(uint32_t), NULL);
+  if (fd < 0 || cvector_read_fd(copy, fd) != cvec_success) {
+    return 1;
+  }
+  close(fd);
+  printf("%-10s %10.1f %10.1f\n", "fd", write_ms,
+         (bench_now_ns() - start) / 1e6);
+
+  int ok = cvector_elem_count64(copy) == ELEM_COUNT;
+  cvector_destroy(copy);
+  cvector_destroy(v);
+  unlink(path);
+  return !ok;
+}
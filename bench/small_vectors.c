@@ -0,0 +1,56 @@
+// Creates a vector, pushes a few elements, sums them and destroys it, over
+// and over, with and without inline storage and custom procs.
+
+#include "bench.h"
+
+#define ROUNDS 2000000u
+
+static cvector_memmgmt_procs_t libc_procs = {
+    .malloc = malloc, .free = free, .calloc = calloc, .realloc = realloc};
+
+static uint64_t churn(const cvector_create_opts_t* opts, int elem_count) {
+  uint64_t sum = 0;
+  for (uint32_t r = 0; r < ROUNDS; ++r) {
+    cvector* v = cvector_create_opts(sizeof(int), opts, NULL);
+    for (int i = 0; i < elem_count; ++i) {
+      cvector_push_back(v, &i);
+    }
+    for (int i = 0; i < elem_count; ++i) {
+      int* elem;
+      cvector_get_ptr_at(v, i, (void**)&elem);
+      sum += *elem;
+    }
+    cvector_destroy(v);
+  }
+  return sum;
+}
+
+int main(void) {
+  printf("%-8s %-18s %10s\n", "elements", "options", "ns/round");
+
+  struct {
+    const char* name;
+    cvector_create_opts_t opts;
+  } configs[] = {
+      {"default", {0}},
+      {"inline_bytes=32", {.inline_bytes = 8 * sizeof(int)}},
+      {"procs", {.mmgmt_procs = &libc_procs}},
+      {"procs+single", {.mmgmt_procs = &libc_procs, .single_allocation = 1}},
+  };
+  int config_count = sizeof(configs) / sizeof(configs[0]);
+
+  int elem_counts[] = {2, 6, 12};
+  for (int c = 0; c < 3; ++c) {
+    for (int k = 0; k < config_count; ++k) {
+      uint64_t start = bench_now_ns();
+      uint64_t sum = churn(&configs[k].opts, elem_counts[c]);
+      double ns = (double)(bench_now_ns() - start) / ROUNDS;
+      printf("%-8d %-18s %10.1f\n", elem_counts[c], configs[k].name, ns);
+      if (sum == 0) {
+        return 1;
+      }
+    }
+  }
+
+  return 0;
+}
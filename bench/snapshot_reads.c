@@ -0,0 +1,99 @@
+// One writer appending while readers keep summing the vector, the readers
+// either taking a read lock or a snapshot.
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "bench.h"
+
+#define ELEM_COUNT (8u * 1024 * 1024)
+#define READERS 4
+
+static cvector* v;
+static pthread_rwlock_t lock;
+static atomic_bool done;
+// Elements the readers went through.
+static atomic_uint_fast64_t scanned;
+static volatile uint64_t sink;
+
+static void* read_locked(void* arg) {
+  (void)arg;
+  while (!atomic_load(&done)) {
+    uint64_t sum = 0;
+    pthread_rwlock_rdlock(&lock);
+    uint64_t count = cvector_elem_count64(v);
+    for (uint64_t i = 0; i < count; ++i) {
+      void* elem;
+      cvector_get_ptr_at64(v, i, &elem);
+      sum += *(uint64_t*)elem;
+    }
+    pthread_rwlock_unlock(&lock);
+    sink = sum;
+    atomic_fetch_add(&scanned, count);
+  }
+  return NULL;
+}
+
+static void* read_snapshots(void* arg) {
+  (void)arg;
+  while (!atomic_load(&done)) {
+    uint64_t sum = 0;
+    cvector_snapshot snapshot;
+    cvector_snapshot_begin(v, &snapshot);
+    const uint64_t* elems = snapshot.data;
+    for (uint64_t i = 0; i < snapshot.elem_count; ++i) {
+      sum += elems[i];
+    }
+    uint64_t count = snapshot.elem_count;
+    cvector_snapshot_end(v, &snapshot);
+    sink = sum;
+    atomic_fetch_add(&scanned, count);
+  }
+  return NULL;
+}
+
+static void run(const char* name, bool snapshots) {
+  cvector_create_opts_t opts = {.snapshot_reads = snapshots};
+  v = cvector_create_opts(sizeof(uint64_t), &opts, NULL);
+  atomic_store(&done, false);
+  atomic_store(&scanned, 0);
+
+  pthread_t readers[READERS];
+  for (int t = 0; t < READERS; ++t) {
+    pthread_create(&readers[t], NULL,
+                   snapshots ? read_snapshots : read_locked, NULL);
+  }
+
+  uint64_t start = bench_now_ns();
+  for (uint64_t i = 0; i < ELEM_COUNT; ++i) {
+    if (snapshots) {
+      cvector_push_back(v, &i);
+    } else {
+      pthread_rwlock_wrlock(&lock);
+      cvector_push_back(v, &i);
+      pthread_rwlock_unlock(&lock);
+    }
+  }
+  double ms = (bench_now_ns() - start) / 1e6;
+  atomic_store(&done, true);
+  for (int t = 0; t < READERS; ++t) {
+    pthread_join(readers[t], NULL);
+  }
+
+  printf("%-10s %12.1f %12.1f\n", name, ms, atomic_load(&scanned) / ms / 1e3);
+  cvector_destroy(v);
+}
+
+int main(void) {
+  // glibc read locks starve writers by default.
+  pthread_rwlockattr_t attr;
+  pthread_rwlockattr_init(&attr);
+  pthread_rwlockattr_setkind_np(&attr,
+                                PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+  pthread_rwlock_init(&lock, &attr);
+
+  printf("%-10s %12s %12s\n", "readers", "writer ms", "Melems/s");
+  run("rwlock", false);
+  run("snapshot", true);
+  return 0;
+}
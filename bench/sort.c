@@ -0,0 +1,58 @@
+// Sorts the same records with qsort, cvector_sort and cvector_sort_by_key.
+
+#include <string.h>
+
+#include "bench.h"
+
+#define ELEM_COUNT 5000000u
+
+typedef struct record {
+  uint64_t key;
+  uint64_t value;
+} record;
+
+static int compare_records(const void* a, const void* b) {
+  uint64_t x = ((const record*)a)->key;
+  uint64_t y = ((const record*)b)->key;
+  return (x > y) - (x < y);
+}
+
+static cvector* make_records(void) {
+  cvector* v = cvector_create(sizeof(record), NULL);
+  cvector_reserve64(v, ELEM_COUNT);
+  uint64_t state = 88172645463325252ull;
+  for (uint64_t i = 0; i < ELEM_COUNT; ++i) {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    record r = {.key = state, .value = i};
+    cvector_push_back(v, &r);
+  }
+  return v;
+}
+
+int main(void) {
+  printf("%-14s %10s\n", "method", "ms");
+
+  cvector* v = make_records();
+  record* data = NULL;
+  cvector_get_ptr_at(v, 0, (void**)&data);
+  uint64_t start = bench_now_ns();
+  qsort(data, ELEM_COUNT, sizeof(record), compare_records);
+  printf("%-14s %10.1f\n", "qsort", (bench_now_ns() - start) / 1e6);
+  cvector_destroy(v);
+
+  v = make_records();
+  start = bench_now_ns();
+  cvector_sort(v, compare_records);
+  printf("%-14s %10.1f\n", "cvector_sort", (bench_now_ns() - start) / 1e6);
+  cvector_destroy(v);
+
+  v = make_records();
+  start = bench_now_ns();
+  cvector_sort_by_key(v, offsetof(record, key), sizeof(uint64_t));
+  printf("%-14s %10.1f\n", "sort_by_key", (bench_now_ns() - start) / 1e6);
+  cvector_destroy(v);
+
+  return 0;
+}
@@ -12,6 +12,7 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <stdlib.h>
 
 typedef struct cvector cvector;
 
@@ -20,11 +21,72 @@ typedef struct cvector_memmgmt_procs_t {
   void (*free)(void* ptr);
   void* (*calloc)(size_t elem_count, size_t elem_size);
   void* (*realloc)(void* ptr, size_t size);
+  // Context carrying procedures, used instead of the ones above when
+  // ctx_malloc is set, in which case the three of them must be. They get
+  // 'ctx' along with the size each block was allocated with, which lets
+  // arenas and pools skip per-block headers. ctx_realloc is called with a
+  // NULL ptr and an old_size of zero to allocate a new block.
+  void* ctx;
+  void* (*ctx_malloc)(void* ctx, size_t size);
+  void* (*ctx_realloc)(void* ctx, void* ptr, size_t old_size,
+                       size_t new_size);
+  void (*ctx_free)(void* ctx, void* ptr, size_t size);
 } cvector_memmgmt_procs_t;
 
+// Helpers going through whichever set of procedures is in use, or through
+// the standard allocator when 'procs' is NULL.
+static inline bool cvector_mm_procs_valid(
+    const cvector_memmgmt_procs_t* procs) {
+  if (!procs) {
+    return true;
+  }
+  if (procs->ctx_malloc) {
+    return procs->ctx_realloc && procs->ctx_free;
+  }
+  return procs->malloc && procs->calloc && procs->realloc && procs->free;
+}
+
+static inline void* cvector_mm_alloc(const cvector_memmgmt_procs_t* procs,
+                                     size_t size) {
+  if (!procs) {
+    return malloc(size);
+  }
+  return procs->ctx_malloc ? procs->ctx_malloc(procs->ctx, size)
+                           : procs->malloc(size);
+}
+
+static inline void* cvector_mm_realloc(const cvector_memmgmt_procs_t* procs,
+                                       void* ptr, size_t old_size,
+                                       size_t new_size) {
+  if (!procs) {
+    return realloc(ptr, new_size);
+  }
+  return procs->ctx_malloc
+             ? procs->ctx_realloc(procs->ctx, ptr, old_size, new_size)
+             : procs->realloc(ptr, new_size);
+}
+
+static inline void cvector_mm_free(const cvector_memmgmt_procs_t* procs,
+                                   void* ptr, size_t size) {
+  if (!ptr) {
+    return;
+  }
+  if (!procs) {
+    free(ptr);
+  } else if (procs->ctx_malloc) {
+    procs->ctx_free(procs->ctx, ptr, size);
+  } else {
+    procs->free(ptr);
+  }
+}
+
 typedef enum cvector_retval_t {
+  // The bounded container has no room left
+  cvec_full = -6,
+  // A system call on a file backing the vector failed
+  cvec_io_error,
   // The provided arguments are not valid
-  cvec_invalid_arguments = -4,
+  cvec_invalid_arguments,
   // The provided key was not found
   cvec_key_not_found,
   // The container is empty
@@ -35,6 +97,234 @@ typedef enum cvector_retval_t {
   cvec_success
 } cvector_retval_t;
 
+typedef enum cvector_growth_kind_t {
+  // Doubles the capacity, this is the default
+  cvec_growth_double = 0,
+  // Grows the capacity by 1.5x
+  cvec_growth_one_and_half,
+  // Grows the capacity by the golden ratio (~1.618x)
+  cvec_growth_golden_ratio,
+  // Doubles buffers smaller than a page, grows larger ones by 1.5x
+  // rounded up to a whole number of pages
+  cvec_growth_page,
+  // Asks the callback of the policy for the new capacity
+  cvec_growth_custom
+} cvector_growth_kind_t;
+
+typedef struct cvector_growth_policy_t {
+  cvector_growth_kind_t kind;
+  // Only used by cvec_growth_custom. Receives the current capacity and the
+  // number of elements that must fit, and returns the new capacity, which
+  // must not be less than 'required'.
+  uint64_t (*callback)(uint64_t capacity, uint64_t required, void* args);
+  void* args;
+} cvector_growth_policy_t;
+
+typedef enum cvector_shrink_kind_t {
+  // Halves the capacity as soon as a pop leaves the vector below its low
+  // water mark, and keeps halving it while it stays below, this is the
+  // default
+  cvec_shrink_auto = 0,
+  // Never shrinks on pops, memory is only released by an explicit
+  // cvector_shrink_to_fit or cvector_reset call
+  cvec_shrink_never,
+  // Shrinks like cvec_shrink_auto, but only on a pop once the vector has
+  // stayed below its low water mark for 'hold_ops' operations in a row,
+  // pushes and pops alike. Getting back above the mark starts over.
+  cvec_shrink_hysteresis
+} cvector_shrink_kind_t;
+
+typedef struct cvector_shrink_policy_t {
+  cvector_shrink_kind_t kind;
+  // The vector is below its low water mark when it holds less than
+  // capacity / low_water_divisor elements. Zero picks the default of 4,
+  // anything else must be at least 2.
+  uint32_t low_water_divisor;
+  // Only used by cvec_shrink_hysteresis
+  uint32_t hold_ops;
+} cvector_shrink_policy_t;
+
+// Zero initialized options give the same vector cvector_create creates.
+typedef struct cvector_create_opts_t {
+  cvector_memmgmt_procs_t* mmgmt_procs;
+  cvector_growth_policy_t growth_policy;
+  cvector_shrink_policy_t shrink_policy;
+  // Bytes of element storage allocated together with the vector itself.
+  // The elements stay there, saving an allocation and a pointer chase,
+  // until they outgrow it and move to the heap. They move back once a
+  // shrink makes them fit again. Less than one element disables it.
+  uint32_t inline_bytes;
+  // Stores the initial elements inline, as if inline_bytes covered at
+  // least the minimum capacity, so that the vector, its copy of the memory
+  // management procedures and its data take a single allocation until
+  // the data outgrows it.
+  bool single_allocation;
+  // Data containers of at least that many bytes are anonymous memory
+  // mappings, bypassing the memory management procs. They grow and shrink
+  // through mremap, which moves pages around instead of copying the
+  // elements and never needs the old and new buffers at the same time.
+  // Zero keeps every data container on the heap.
+  uint64_t mmap_threshold;
+  // Asks for transparent huge pages on the mapped data containers, which
+  // cuts TLB misses when scanning large vectors.
+  bool huge_pages;
+  // Lets other threads read the vector through snapshots while a single
+  // writer modifies it, see cvector_snapshot_begin. Needs the data
+  // container on the heap, i.e. no inline storage nor mapping.
+  bool snapshot_reads;
+  // Makes the data container a ring buffer, with a power of two capacity,
+  // so that cvector_push_front and cvector_pop_front take constant time.
+  // Indexes stay relative to the first element. Operations that need the
+  // elements to be contiguous, like sorting, searching, the kernels or
+  // cvector_exec_for_each, first unwrap the ring, which takes a copy of
+  // the elements when it wraps around. Needs the data container on the
+  // heap, i.e. no inline storage, mapping nor snapshot reads.
+  bool deque;
+} cvector_create_opts_t;
+
+cvector* cvector_create_opts(uint32_t elem_size,
+                             const cvector_create_opts_t* opts, char** err);
+
+// A bump allocator carving blocks out of large chunks. Freeing a block only
+// gives memory back when it is the latest allocation, everything else is
+// reclaimed at once by cvector_arena_reset, which must only be called once
+// no vector uses the arena anymore. A block_size of zero picks 64KiB.
+typedef struct cvector_arena cvector_arena;
+
+cvector_arena* cvector_arena_create(size_t block_size, char** err);
+
+void cvector_arena_reset(cvector_arena* arena);
+
+void __cvector_arena_destroy(cvector_arena* arena);
+
+#define cvector_arena_destroy(arena)  \
+  do {                                \
+    if (arena) {                      \
+      __cvector_arena_destroy(arena); \
+      arena = NULL;                   \
+    }                                 \
+  } while (0)
+
+// Returns the procedures to pass to cvector_create_mp for vectors to
+// allocate from the arena.
+cvector_memmgmt_procs_t cvector_arena_procs(cvector_arena* arena);
+
+// An allocator keeping freed blocks in per size class free lists, the
+// classes being the powers of two from 16 bytes to 64KiB. Larger blocks
+// are left to the standard allocator. The pool must outlive the vectors
+// using it.
+typedef struct cvector_pool cvector_pool;
+
+cvector_pool* cvector_pool_create(char** err);
+
+void __cvector_pool_destroy(cvector_pool* pool);
+
+#define cvector_pool_destroy(pool)  \
+  do {                              \
+    if (pool) {                     \
+      __cvector_pool_destroy(pool); \
+      pool = NULL;                  \
+    }                               \
+  } while (0)
+
+cvector_memmgmt_procs_t cvector_pool_procs(cvector_pool* pool);
+
+// Neither the arena nor the pool is thread safe.
+
+typedef enum cvector_file_flags_t {
+  // Creates the file if it does not exist
+  cvec_file_create = 1,
+  // Drops the elements the file holds
+  cvec_file_truncate = 2
+} cvector_file_flags_t;
+
+// Opens a vector whose elements live in the file at 'path', mapped in
+// shared mode so that they are the page cache of the file. A new or empty
+// file starts an empty vector. An existing one is validated through its
+// header, which records the element size, count and capacity along with
+// a checksum, and then used as it is without reading the elements.
+// Growing the vector extends the file and remaps it. cvector_destroy
+// unmaps and closes the file, leaving it up to date on disk.
+cvector* cvector_open_file(const char* path, uint32_t elem_size,
+                           uint32_t flags, char** err);
+
+// Writes the header and the modified pages of a vector opened by
+// cvector_open_file back to the file, returning once they are on disk.
+// After a crash, reopening the file gives the vector as of the last sync.
+cvector_retval_t cvector_sync(cvector* v);
+
+// Writes the vector to a file descriptor as a 32 byte header (magic,
+// format version, byte order mark, element size and count) followed by the
+// raw elements, in a single writev call whenever the descriptor accepts
+// it all at once.
+cvector_retval_t cvector_write_fd(cvector* v, int fd);
+
+// Appends the elements of a stream written by cvector_write_fd, reserving
+// room for all of them first and reading them straight into the data
+// container. Fails with cvec_invalid_arguments when the element sizes
+// differ and with cvec_io_error on malformed or truncated streams, or
+// streams written on a machine of the other byte order. The vector is
+// unchanged on failure, its capacity aside.
+cvector_retval_t cvector_read_fd(cvector* v, int fd);
+
+// A consistent view of a vector created with snapshot_reads, which other
+// threads can take without locking while a single writer keeps modifying
+// the vector. 'data' holds 'elem_count' elements and stays valid until
+// cvector_snapshot_end, even if the writer moves the elements to a new data
+// container meanwhile: the old containers are only freed once every
+// snapshot that may point into them has ended. Appended elements are never
+// seen half written. Other modifications happen in place, so a snapshot may
+// see the elements the writer is erasing, overwriting or sorting change
+// under it. At most CVEC_SNAPSHOT_READERS snapshots can be open at once,
+// cvector_snapshot_begin fails with cvec_not_enough_memory beyond that.
+#define CVEC_SNAPSHOT_READERS 64
+
+typedef struct cvector_snapshot {
+  const void* data;
+  uint64_t elem_count;
+  uint32_t elem_size;
+  // Private to the library.
+  uint32_t slot;
+} cvector_snapshot;
+
+cvector_retval_t cvector_snapshot_begin(cvector* v,
+                                        cvector_snapshot* snapshot);
+
+void cvector_snapshot_end(cvector* v, cvector_snapshot* snapshot);
+
+// Visits the elements of a snapshot taken for the duration of the call.
+cvector_retval_t cvector_snapshot_exec_for_each(
+    cvector* v, void (*read_callback)(uint64_t index, const void* elem,
+                                      void* args),
+    void* args);
+
+// Frees the retired data containers no snapshot can point into anymore.
+// The writer does it whenever it retires a container, this is for writers
+// that stopped growing the vector. Must be called by the writer.
+cvector_retval_t cvector_snapshot_reclaim(cvector* v);
+
+// Storage for a vector header that lives in memory owned by the caller,
+// e.g. inside another struct, in an array or on the stack. Its contents
+// are private to the library, and it must neither be copied nor moved
+// while the vector is in use, as the vector returned by cvector_init
+// points into it. The size leaves room for the header to grow.
+#define CVEC_STORAGE_SIZE 256
+
+typedef union cvector_storage {
+  max_align_t align;
+  unsigned char bytes[CVEC_STORAGE_SIZE];
+} cvector_storage;
+
+// Initializes a vector inside 'storage' and returns it, or NULL on failure.
+// Only the data container is heap allocated, so the options can not ask
+// for inline storage. The returned vector works with the whole API and
+// must be released with cvector_deinit, cvector_destroy then frees its
+// data but leaves the storage alone.
+cvector* cvector_init(cvector_storage* storage, uint32_t elem_size,
+                      const cvector_create_opts_t* opts, char** err);
+
+void cvector_deinit(cvector* v);
+
 cvector* cvector_create_mp(uint32_t elem_size,
                            cvector_memmgmt_procs_t* mmgmt_procs, char** err);
 
@@ -52,23 +342,459 @@ void __cvector_destroy(cvector* v);
 
 cvector_retval_t cvector_push_back(cvector* v, const void* new_elem);
 
+// Appends 'count' consecutive elements starting at 'new_elems'. The
+// capacity is adjusted once for the whole batch and the elements are
+// copied in one go. On failure the vector is left untouched.
+cvector_retval_t cvector_push_back_n(cvector* v, const void* new_elems,
+                                     uint32_t count);
+
 cvector_retval_t cvector_pop_back(cvector* v, void* target_elem);
 
+// Only for vectors created in deque mode, fail with cvec_invalid_arguments
+// otherwise.
+cvector_retval_t cvector_push_front(cvector* v, const void* new_elem);
+
+cvector_retval_t cvector_pop_front(cvector* v, void* target_elem);
+
+// Inserts 'count' consecutive elements starting at 'new_elems' before the
+// element at 'index', moving the ones after it with a single memmove. An
+// index equal to the element count appends. The new elements must not be
+// stored in the vector itself. On failure the vector is left untouched.
+cvector_retval_t cvector_insert_n_at(cvector* v, uint64_t index,
+                                    const void* new_elems, uint64_t count);
+
+cvector_retval_t cvector_insert_at(cvector* v, uint64_t index,
+                                   const void* new_elem);
+
+// Removes the elements in [first, last), shrinking the vector the same
+// way cvector_pop_back does, however many halvings it takes to get it back
+// above its low water mark.
+cvector_retval_t cvector_erase_range(cvector* v, uint64_t first,
+                                     uint64_t last);
+
+// Removes every element the predicate returns true for, keeping the order
+// of the others. The predicate is called once per element, in order, and
+// the survivors are compacted in the same pass. Shrinks the vector like
+// cvector_erase_range.
+cvector_retval_t cvector_erase_if(cvector* v,
+                                  bool (*pred)(const void* elem, void* args),
+                                  void* args);
+
+// Removes the element at 'index' by moving the last element into its slot,
+// so the order of the elements is not preserved. The removed element is
+// copied to 'target_elem' unless it is NULL. Shrinks the vector the same
+// way cvector_pop_back does.
+cvector_retval_t cvector_swap_remove(cvector* v, uint64_t index,
+                                     void* target_elem);
+
+// Swap-removes the elements at the 'count' given indexes, which must be
+// sorted in strictly ascending order. Each removal moves at most one
+// element. Nothing is removed if any of the indexes is out of range.
+// Shrinks the vector like cvector_erase_range.
+cvector_retval_t cvector_swap_remove_n(cvector* v, const uint64_t* indexes,
+                                       uint64_t count);
+
 cvector_retval_t cvector_get_copy_at(cvector* v, uint32_t index,
                                      void* target_elem);
 
 cvector_retval_t cvector_get_ptr_at(cvector* v, uint32_t index,
                                     void** target_elem_ptr);
 
+// Saturates at UINT32_MAX, use cvector_elem_count64 for larger vectors.
 uint32_t cvector_elem_count(cvector* v);
 
 void cvector_reset(cvector* v);
 
+// Saturates at UINT32_MAX, use cvector_capacity64 for larger vectors.
+uint32_t cvector_capacity(cvector* v);
+
+// Makes sure that 'capacity' elements can be stored without any further
+// reallocation. Never reduces the capacity.
+cvector_retval_t cvector_reserve(cvector* v, uint32_t capacity);
+
+// Releases the unused part of the data container, keeping at least the
+// minimum capacity a fresh vector starts with.
+cvector_retval_t cvector_shrink_to_fit(cvector* v);
+
+// Visits every element, the index passed to the callback wraps around for
+// vectors holding more than UINT32_MAX elements.
 void cvector_exec_for_each(cvector* v,
                            void (*read_write_callback)(uint32_t index,
                                                        void* elem, void* args),
                            void* args);
 
+// 64-bit counterparts of the functions above, for vectors that may hold
+// more than UINT32_MAX elements. All size arithmetic is overflow checked,
+// requests that can not be represented fail with cvec_not_enough_memory.
+cvector_retval_t cvector_push_back_n64(cvector* v, const void* new_elems,
+                                       uint64_t count);
+
+cvector_retval_t cvector_get_copy_at64(cvector* v, uint64_t index,
+                                       void* target_elem);
+
+cvector_retval_t cvector_get_ptr_at64(cvector* v, uint64_t index,
+                                      void** target_elem_ptr);
+
+uint64_t cvector_elem_count64(cvector* v);
+
+uint64_t cvector_capacity64(cvector* v);
+
+cvector_retval_t cvector_reserve64(cvector* v, uint64_t capacity);
+
+void cvector_exec_for_each64(cvector* v,
+                             void (*read_write_callback)(uint64_t index,
+                                                         void* elem,
+                                                         void* args),
+                             void* args);
+
+// Hands the elements to the callback as contiguous spans of up to
+// 'batch_size' elements, so that the callback can loop over them itself
+// and the indirect call is paid once per span. A batch_size of zero passes
+// the whole vector in a single span. Empty vectors cause no calls.
+void cvector_exec_for_each_batch(cvector* v,
+                                 void (*batch_callback)(uint64_t start_index,
+                                                        void* elems,
+                                                        uint64_t count,
+                                                        void* args),
+                                 void* args, uint64_t batch_size);
+
+// A pool of worker threads cvector_exec_for_each_parallel can spread the
+// work over. The pool can be reused for any number of calls. A thread_count
+// of zero picks the number of online CPUs. The calling thread counts as one
+// of the threads, so a pool of N threads starts N - 1 workers.
+typedef struct cvector_thread_pool cvector_thread_pool;
+
+cvector_thread_pool* cvector_thread_pool_create(uint32_t thread_count,
+                                                char** err);
+
+void __cvector_thread_pool_destroy(cvector_thread_pool* pool);
+
+#define cvector_thread_pool_destroy(pool)  \
+  do {                                     \
+    if (pool) {                            \
+      __cvector_thread_pool_destroy(pool); \
+      pool = NULL;                         \
+    }                                      \
+  } while (0)
+
+uint32_t cvector_thread_pool_size(cvector_thread_pool* pool);
+
+// Calls the callback for every element, spreading chunks of 'grain_size'
+// elements over the threads of the pool, and returns once all of them
+// are processed. Chunk boundaries are rounded to cache lines whenever the
+// element size permits. A grain_size of zero gives each thread a few
+// chunks, and a NULL pool runs everything on the calling thread. The
+// callback must be safe to call concurrently on distinct elements.
+cvector_retval_t cvector_exec_for_each_parallel(
+    cvector* v,
+    void (*read_write_callback)(uint64_t index, void* elem, void* args),
+    void* args, cvector_thread_pool* pool, uint64_t grain_size);
+
+// A vector any number of threads can append to at once. Producers claim
+// their slots with a compare and swap on a shared counter and copy their
+// elements in without taking a lock. The storage grows by adding segments,
+// each twice as large as the previous one, so published elements never move
+// and the pointers to them stay valid until the vector is destroyed.
+// Elements only become visible, through the count and the accessors, once
+// every element before them is written, so readers always see a gapless
+// prefix. Producers never wait for each other, an append may hence return
+// before its elements are visible, when some producer that claimed earlier
+// slots is still copying. The memory management procedures, NULL for the
+// standard ones, allocate the vector itself as well as its segments and
+// must be thread safe.
+typedef struct cvector_concurrent cvector_concurrent;
+
+cvector_concurrent* cvector_concurrent_create(
+    uint32_t elem_size, cvector_memmgmt_procs_t* mmgt_procs, char** err);
+
+void __cvector_concurrent_destroy(cvector_concurrent* v);
+
+#define cvector_concurrent_destroy(v)  \
+  do {                                 \
+    if (v) {                           \
+      __cvector_concurrent_destroy(v); \
+      v = NULL;                        \
+    }                                  \
+  } while (0)
+
+// Thread safe. Allocates the segments needed for 'capacity' elements up
+// front, taking segment allocation off the producers' path.
+cvector_retval_t cvector_concurrent_reserve(cvector_concurrent* v,
+                                            uint64_t capacity);
+
+// Thread safe. Appends 'count' elements as one contiguous run, storing the
+// index of the first one in 'first_index' unless it is NULL. Runs that do
+// not fit in the largest possible vector fail with cvec_not_enough_memory
+// and claim nothing. A segment that fails to allocate leaves the vector
+// refusing any further appends with cvec_not_enough_memory, as the slots it
+// was claimed for can never be published.
+cvector_retval_t cvector_concurrent_push_back_n(cvector_concurrent* v,
+                                                const void* new_elems,
+                                                uint64_t count,
+                                                uint64_t* first_index);
+
+cvector_retval_t cvector_concurrent_push_back(cvector_concurrent* v,
+                                              const void* new_elem,
+                                              uint64_t* index);
+
+// Number of published elements.
+uint64_t cvector_concurrent_elem_count(cvector_concurrent* v);
+
+cvector_retval_t cvector_concurrent_get_copy_at(cvector_concurrent* v,
+                                                uint64_t index,
+                                                void* target_elem);
+
+cvector_retval_t cvector_concurrent_get_ptr_at(cvector_concurrent* v,
+                                               uint64_t index,
+                                               void** target_elem_ptr);
+
+// Visits the elements published by the time of the call.
+void cvector_concurrent_exec_for_each(
+    cvector_concurrent* v,
+    void (*read_write_callback)(uint64_t index, void* elem, void* args),
+    void* args);
+
+// A single threaded vector whose elements never move. It grows by adding
+// segments, each twice as large as the previous one, rather than by
+// reallocating, so the pointers cvector_segmented_get_ptr_at hands out stay
+// valid until the element is popped or the vector destroyed, and growth
+// never copies the existing elements. Indexing maps to a segment and an
+// offset with a leading zero count.
+typedef struct cvector_segmented cvector_segmented;
+
+cvector_segmented* cvector_segmented_create(
+    uint32_t elem_size, cvector_memmgmt_procs_t* mmgt_procs, char** err);
+
+void __cvector_segmented_destroy(cvector_segmented* v);
+
+#define cvector_segmented_destroy(v)  \
+  do {                                \
+    if (v) {                          \
+      __cvector_segmented_destroy(v); \
+      v = NULL;                       \
+    }                                 \
+  } while (0)
+
+cvector_retval_t cvector_segmented_push_back(cvector_segmented* v,
+                                             const void* new_elem);
+
+cvector_retval_t cvector_segmented_push_back_n(cvector_segmented* v,
+                                               const void* new_elems,
+                                               uint64_t count);
+
+// Popping keeps the segments around, cvector_segmented_shrink_to_fit
+// releases the ones left empty.
+cvector_retval_t cvector_segmented_pop_back(cvector_segmented* v,
+                                            void* target_elem);
+
+cvector_retval_t cvector_segmented_get_copy_at(cvector_segmented* v,
+                                               uint64_t index,
+                                               void* target_elem);
+
+cvector_retval_t cvector_segmented_get_ptr_at(cvector_segmented* v,
+                                              uint64_t index,
+                                              void** target_elem_ptr);
+
+uint64_t cvector_segmented_elem_count(cvector_segmented* v);
+
+uint64_t cvector_segmented_capacity(cvector_segmented* v);
+
+cvector_retval_t cvector_segmented_reserve(cvector_segmented* v,
+                                           uint64_t capacity);
+
+cvector_retval_t cvector_segmented_shrink_to_fit(cvector_segmented* v);
+
+void cvector_segmented_exec_for_each(
+    cvector_segmented* v,
+    void (*read_write_callback)(uint64_t index, void* elem, void* args),
+    void* args);
+
+// Bounded FIFO queues passing fixed size elements between threads without
+// locks, over a ring of 'capacity' elements rounded up to a power of two.
+// The single producer/single consumer queue only takes one thread on each
+// side, the multi producer/multi consumer one any number of them. The
+// batched calls move up to 'count' elements at once with a single atomic
+// update of the queue indexes, storing how many they moved unless the
+// pointer is NULL, and fail with cvec_full or cvec_empty when they move
+// none. Nothing ever blocks: callers decide how to wait, e.g. by spinning
+// or yielding. The element count is approximate while other threads use
+// the queue. The memory management procedures, NULL for the standard ones,
+// allocate the queue itself as well as its ring and must be thread safe.
+typedef struct cvector_spsc_queue cvector_spsc_queue;
+
+cvector_spsc_queue* cvector_spsc_queue_create(
+    uint32_t elem_size, uint64_t capacity,
+    cvector_memmgmt_procs_t* mmgt_procs, char** err);
+
+void __cvector_spsc_queue_destroy(cvector_spsc_queue* q);
+
+#define cvector_spsc_queue_destroy(q)  \
+  do {                                 \
+    if (q) {                           \
+      __cvector_spsc_queue_destroy(q); \
+      q = NULL;                        \
+    }                                  \
+  } while (0)
+
+cvector_retval_t cvector_spsc_queue_enqueue(cvector_spsc_queue* q,
+                                            const void* elem);
+
+cvector_retval_t cvector_spsc_queue_enqueue_n(cvector_spsc_queue* q,
+                                              const void* elems,
+                                              uint64_t count,
+                                              uint64_t* enqueued);
+
+cvector_retval_t cvector_spsc_queue_dequeue(cvector_spsc_queue* q,
+                                            void* target_elem);
+
+cvector_retval_t cvector_spsc_queue_dequeue_n(cvector_spsc_queue* q,
+                                              void* target_elems,
+                                              uint64_t count,
+                                              uint64_t* dequeued);
+
+uint64_t cvector_spsc_queue_elem_count(cvector_spsc_queue* q);
+
+uint64_t cvector_spsc_queue_capacity(cvector_spsc_queue* q);
+
+typedef struct cvector_mpmc_queue cvector_mpmc_queue;
+
+cvector_mpmc_queue* cvector_mpmc_queue_create(
+    uint32_t elem_size, uint64_t capacity,
+    cvector_memmgmt_procs_t* mmgt_procs, char** err);
+
+void __cvector_mpmc_queue_destroy(cvector_mpmc_queue* q);
+
+#define cvector_mpmc_queue_destroy(q)  \
+  do {                                 \
+    if (q) {                           \
+      __cvector_mpmc_queue_destroy(q); \
+      q = NULL;                        \
+    }                                  \
+  } while (0)
+
+cvector_retval_t cvector_mpmc_queue_enqueue(cvector_mpmc_queue* q,
+                                            const void* elem);
+
+// The elements a batch moves stay in order and next to each other in the
+// queue, even when other producers or consumers run at the same time.
+cvector_retval_t cvector_mpmc_queue_enqueue_n(cvector_mpmc_queue* q,
+                                              const void* elems,
+                                              uint64_t count,
+                                              uint64_t* enqueued);
+
+cvector_retval_t cvector_mpmc_queue_dequeue(cvector_mpmc_queue* q,
+                                            void* target_elem);
+
+cvector_retval_t cvector_mpmc_queue_dequeue_n(cvector_mpmc_queue* q,
+                                              void* target_elems,
+                                              uint64_t count,
+                                              uint64_t* dequeued);
+
+uint64_t cvector_mpmc_queue_elem_count(cvector_mpmc_queue* q);
+
+uint64_t cvector_mpmc_queue_capacity(cvector_mpmc_queue* q);
+
+// Numeric kernels for vectors of primitive types. The element size of the
+// vector must match the type in the function name, otherwise they fail
+// with cvec_invalid_arguments. They run on the widest SIMD instruction set
+// the CPU supports (SSE2, AVX2 or AVX-512 on x86-64), with a scalar
+// fallback elsewhere. Integer sums and dot products are accumulated in 64
+// bits, floating point ones in the element type and, like the min/max of
+// vectors containing NaNs, may differ slightly between instruction sets.
+typedef enum cvector_simd_level_t {
+  cvec_simd_scalar = 0,
+  cvec_simd_sse2,
+  cvec_simd_avx2,
+  cvec_simd_avx512
+} cvector_simd_level_t;
+
+// Returns the instruction set the kernels currently run on.
+cvector_simd_level_t cvector_simd_level(void);
+
+// Forces the kernels to a given instruction set, e.g. to compare them.
+// Fails if the CPU does not support it.
+cvector_retval_t cvector_set_simd_level(cvector_simd_level_t level);
+
+cvector_retval_t cvector_sum_i32(cvector* v, int64_t* result);
+cvector_retval_t cvector_sum_i64(cvector* v, int64_t* result);
+cvector_retval_t cvector_sum_f32(cvector* v, float* result);
+cvector_retval_t cvector_sum_f64(cvector* v, double* result);
+
+// Either of min and max may be NULL. Fails with cvec_empty on empty vectors.
+cvector_retval_t cvector_minmax_i32(cvector* v, int32_t* min, int32_t* max);
+cvector_retval_t cvector_minmax_i64(cvector* v, int64_t* min, int64_t* max);
+cvector_retval_t cvector_minmax_f32(cvector* v, float* min, float* max);
+cvector_retval_t cvector_minmax_f64(cvector* v, double* min, double* max);
+
+// Sets every element of the vector to 'value'.
+cvector_retval_t cvector_fill_i32(cvector* v, int32_t value);
+cvector_retval_t cvector_fill_i64(cvector* v, int64_t value);
+cvector_retval_t cvector_fill_f32(cvector* v, float value);
+cvector_retval_t cvector_fill_f64(cvector* v, double value);
+
+// Multiplies every element of the vector by 'factor'.
+cvector_retval_t cvector_scale_i32(cvector* v, int32_t factor);
+cvector_retval_t cvector_scale_i64(cvector* v, int64_t factor);
+cvector_retval_t cvector_scale_f32(cvector* v, float factor);
+cvector_retval_t cvector_scale_f64(cvector* v, double factor);
+
+// Both vectors must hold the same number of elements.
+cvector_retval_t cvector_dot_i32(cvector* a, cvector* b, int64_t* result);
+cvector_retval_t cvector_dot_i64(cvector* a, cvector* b, int64_t* result);
+cvector_retval_t cvector_dot_f32(cvector* a, cvector* b, float* result);
+cvector_retval_t cvector_dot_f64(cvector* a, cvector* b, double* result);
+
+// Sorts the vector in ascending order as defined by 'cmp', which follows
+// the qsort convention. The sort is an introsort with swaps specialized
+// for the common element sizes, it is not stable.
+cvector_retval_t cvector_sort(cvector* v,
+                              int (*cmp)(const void* a, const void* b));
+
+// Stable LSD radix sort on an unsigned integer key of 'key_size' bytes
+// (1, 2, 4 or 8, in native byte order) stored 'key_offset' bytes into
+// each element. Needs a scratch buffer as large as the elements in use.
+cvector_retval_t cvector_sort_by_key(cvector* v, uint32_t key_offset,
+                                     uint32_t key_size);
+
+// Binary searches on a vector sorted in ascending order. The comparator
+// follows the bsearch convention, receiving the searched key first. The
+// lower bound is the index of the first element not less than the key,
+// the upper bound the index of the first element greater than it, both
+// being the element count when there is none. equal_range fills
+// [first, last) with the elements equal to the key and returns
+// cvec_key_not_found when that range is empty.
+cvector_retval_t cvector_lower_bound(cvector* v, const void* key,
+                                     int (*cmp)(const void* key,
+                                                const void* elem),
+                                     uint64_t* index);
+cvector_retval_t cvector_upper_bound(cvector* v, const void* key,
+                                     int (*cmp)(const void* key,
+                                                const void* elem),
+                                     uint64_t* index);
+cvector_retval_t cvector_equal_range(cvector* v, const void* key,
+                                     int (*cmp)(const void* key,
+                                                const void* elem),
+                                     uint64_t* first, uint64_t* last);
+
+// The same searches on an unsigned integer key laid out as for
+// cvector_sort_by_key.
+cvector_retval_t cvector_lower_bound_by_key(cvector* v, uint32_t key_offset,
+                                            uint32_t key_size, uint64_t key,
+                                            uint64_t* index);
+cvector_retval_t cvector_upper_bound_by_key(cvector* v, uint32_t key_offset,
+                                            uint32_t key_size, uint64_t key,
+                                            uint64_t* index);
+cvector_retval_t cvector_equal_range_by_key(cvector* v, uint32_t key_offset,
+                                            uint32_t key_size, uint64_t key,
+                                            uint64_t* first, uint64_t* last);
+
+// Stores the lower bound of each of the 'key_count' keys in 'indexes'.
+// Keys given in ascending order are answered in a single forward pass over
+// the vector, each search starting where the previous one ended.
+cvector_retval_t cvector_lower_bound_batch_by_key(
+    cvector* v, uint32_t key_offset, uint32_t key_size, const uint64_t* keys,
+    uint64_t key_count, uint64_t* indexes);
+
 // Some useful macros
 #define CVEC_DECLARE(v) cvector* v
 
@@ -109,6 +835,15 @@ void cvector_exec_for_each(cvector* v,
     }                                                                         \
   } while (0)
 
+#define CVEC_PUSH_ARRAY(v, arr)                                           \
+  do {                                                                    \
+    cvector_retval_t r = cvector_push_back_n(                             \
+        v, (const void*)(arr), (uint32_t)(sizeof(arr) / sizeof(*(arr)))); \
+    if (r != cvec_success) {                                              \
+      assert(r == cvec_success);                                          \
+    }                                                                     \
+  } while (0)
+
 #define CVEC_POP(target, v)                            \
   do {                                                 \
     cvector_retval_t r = cvector_pop_back(v, &target); \
@@ -135,7 +870,159 @@ void cvector_exec_for_each(cvector* v,
 
 #define CVEC_SIZE(v) cvector_elem_count(v)
 
+#define CVEC_SIZE64(v) cvector_elem_count64(v)
+
 #define CVEC_RESET(v) cvector_reset(v)
 
+#define CVEC_CAPACITY(v) cvector_capacity(v)
+
 #define CVEC_FOR_EACH(v, writer_f, args) \
   cvector_exec_for_each(v, writer_f, (void*)args)
+
+#define CVEC_FOR_EACH_BATCH(v, batch_f, args, batch_size) \
+  cvector_exec_for_each_batch(v, batch_f, (void*)args, batch_size)
+
+// CVEC_DEFINE(type, name) generates a vector type dedicated to 'type',
+// along with static inline functions operating on it. As the element type
+// is known at compile time, the accessors boil down to plain array
+// indexing and can be inlined into the caller's loops. Only the growth
+// path is kept out of line.
+//
+//   CVEC_DEFINE(double, dvec);
+//
+//   dvec v;
+//   dvec_init(&v);
+//   dvec_push(&v, 3.0);
+//   double d = dvec_at(&v, 0);
+//   dvec_destroy(&v);
+//
+// The data is allocated through the given cvector_memmgmt_procs_t, or
+// through the standard allocator when none is provided. The memory
+// management procs are copied, just like cvector_create_mp does.
+#define CVEC_DEFINE(type, name)                                               \
+  typedef struct name {                                                       \
+    type* data;                                                               \
+    uint64_t count;                                                           \
+    uint64_t capacity;                                                        \
+    cvector_memmgmt_procs_t m_procs;                                          \
+  } name;                                                                     \
+                                                                              \
+  static inline cvector_retval_t name##_init_mp(                              \
+      name* v, cvector_memmgmt_procs_t* mmgmt_procs) {                        \
+    if (!v) {                                                                 \
+      return cvec_invalid_arguments;                                          \
+    }                                                                         \
+    if (!cvector_mm_procs_valid(mmgmt_procs)) {                               \
+      return cvec_invalid_arguments;                                          \
+    }                                                                         \
+    v->data = NULL;                                                           \
+    v->count = 0;                                                             \
+    v->capacity = 0;                                                          \
+    if (mmgmt_procs) {                                                        \
+      v->m_procs = *mmgmt_procs;                                              \
+    } else {                                                                  \
+      v->m_procs = (cvector_memmgmt_procs_t){.malloc = malloc,                \
+                                             .free = free,                    \
+                                             .calloc = calloc,                \
+                                             .realloc = realloc};             \
+    }                                                                         \
+    return cvec_success;                                                      \
+  }                                                                           \
+                                                                              \
+  static inline cvector_retval_t name##_init(name* v) {                       \
+    return name##_init_mp(v, NULL);                                           \
+  }                                                                           \
+                                                                              \
+  static inline void name##_destroy(name* v) {                                \
+    if (v && v->data) {                                                       \
+      cvector_mm_free(&v->m_procs, v->data, v->capacity * sizeof(type));      \
+      v->data = NULL;                                                         \
+      v->count = 0;                                                           \
+      v->capacity = 0;                                                        \
+    }                                                                         \
+  }                                                                           \
+                                                                              \
+  static inline cvector_retval_t name##_set_capacity(name* v,                 \
+                                                     uint64_t capacity) {     \
+    if (capacity > PTRDIFF_MAX / sizeof(type)) {                              \
+      return cvec_not_enough_memory;                                          \
+    }                                                                         \
+    type* data = (type*)cvector_mm_realloc(&v->m_procs, v->data,              \
+                                           v->capacity * sizeof(type),        \
+                                           capacity * sizeof(type));          \
+    if (!data) {                                                              \
+      return cvec_not_enough_memory;                                          \
+    }                                                                         \
+    v->data = data;                                                           \
+    v->capacity = capacity;                                                   \
+    return cvec_success;                                                      \
+  }                                                                           \
+                                                                              \
+  static inline cvector_retval_t name##_reserve(name* v, uint64_t capacity) { \
+    if (!v) {                                                                 \
+      return cvec_invalid_arguments;                                          \
+    }                                                                         \
+    return capacity <= v->capacity ? cvec_success                             \
+                                   : name##_set_capacity(v, capacity);        \
+  }                                                                           \
+                                                                              \
+  static inline cvector_retval_t name##_shrink_to_fit(name* v) {              \
+    if (!v) {                                                                 \
+      return cvec_invalid_arguments;                                          \
+    }                                                                         \
+    if (v->count == v->capacity) {                                            \
+      return cvec_success;                                                    \
+    }                                                                         \
+    if (v->count == 0) {                                                      \
+      name##_destroy(v);                                                      \
+      return cvec_success;                                                    \
+    }                                                                         \
+    return name##_set_capacity(v, v->count);                                  \
+  }                                                                           \
+                                                                              \
+  static __attribute__((noinline, unused)) cvector_retval_t                   \
+      name##_grow_and_push(name* v, type new_elem) {                          \
+    uint64_t capacity = v->capacity ? v->capacity * 2 : 4;                    \
+    cvector_retval_t r = name##_set_capacity(v, capacity);                    \
+    if (r == cvec_success) {                                                  \
+      v->data[v->count++] = new_elem;                                         \
+    }                                                                         \
+    return r;                                                                 \
+  }                                                                           \
+                                                                              \
+  static inline cvector_retval_t name##_push(name* v, type new_elem) {        \
+    if (v->count < v->capacity) {                                             \
+      v->data[v->count++] = new_elem;                                         \
+      return cvec_success;                                                    \
+    }                                                                         \
+    return name##_grow_and_push(v, new_elem);                                 \
+  }                                                                           \
+                                                                              \
+  static inline cvector_retval_t name##_pop(name* v, type* target_elem) {     \
+    if (v->count == 0) {                                                      \
+      return cvec_empty;                                                      \
+    }                                                                         \
+    *target_elem = v->data[--v->count];                                       \
+    return cvec_success;                                                      \
+  }                                                                           \
+                                                                              \
+  static inline type name##_at(const name* v, uint64_t index) {               \
+    assert(index < v->count);                                                 \
+    return v->data[index];                                                    \
+  }                                                                           \
+                                                                              \
+  static inline type* name##_ptr(name* v, uint64_t index) {                   \
+    assert(index < v->count);                                                 \
+    return &v->data[index];                                                   \
+  }                                                                           \
+                                                                              \
+  static inline type* name##_data(name* v) { return v->data; }                \
+                                                                              \
+  static inline uint64_t name##_size(const name* v) { return v->count; }      \
+                                                                              \
+  static inline uint64_t name##_capacity(const name* v) {                     \
+    return v->capacity;                                                       \
+  }                                                                           \
+                                                                              \
+  static inline void name##_clear(name* v) { v->count = 0; }
+
@@ -22,52 +22,97 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 SOFTWARE.
 */
 
-#include <cvector.h>
+#include "cvector_internal.h"
+
 #include <stdlib.h>
 #include <string.h>
-
-#define mem_alloc(size) malloc(size)
-#define mem_calloc(elem_count, elem_size) calloc(elem_count, elem_size)
-#define mem_realloc(ptr, new_size) realloc(ptr, new_size)
-#define mem_free(ptr) free(ptr)
-
-#define _mem_alloc(m_procs, size) \
-  (m_procs) ? m_procs->malloc(size) : mem_alloc(size)
-#define _mem_calloc(m_procs, e_count, e_size) \
-  (m_procs) ? m_procs->calloc(e_count, e_size) : mem_calloc(e_count, e_size)
-#define _mem_realloc(m_procs, ptr, new_size) \
-  (m_procs) ? m_procs->realloc(ptr, new_size) : mem_realloc(ptr, new_size)
-#define _mem_free(m_procs, ptr) (m_procs) ? m_procs->free(ptr) : mem_free(ptr)
-
-#define stringify(s) #s
-#define x_stringify(s) stringify(s)
-#define CERR_STR(x) (__FILE__ ":" x_stringify(__LINE__) " - " x)
+#include <sys/mman.h>
+#include <unistd.h>
 
 const uint32_t minimum_capacity = 4;
 const uint32_t scaling_factor = 2;
 
-struct cvector {
-  uint32_t elem_size;
-  uint32_t elem_count;
-  uint32_t capacity;
-  cvector_memmgmt_procs_t* m_procs;
-  void* data_ptr;
-};
+_Static_assert(sizeof(cvector) <= sizeof(cvector_storage),
+               "cvector_storage is too small to hold a cvector");
+_Static_assert(_Alignof(cvector) <= _Alignof(cvector_storage),
+               "cvector_storage is not aligned enough to hold a cvector");
+
+// Gives the data container back, unless it is the inline buffer.
+static void release_the_cvector_data(cvector* v) {
+  if (v->data_is_file) {
+    close_the_cvector_file(v);
+  } else if (v->readers) {
+    destroy_the_cvector_readers(v);
+  } else if (v->data_is_mapped) {
+    munmap(v->data_ptr, v->mapped_bytes);
+    v->data_is_mapped = false;
+  } else if (!cvector_data_is_inline(v)) {
+    _mem_free(cvector_procs(v), v->data_ptr, cvector_data_size(v));
+  }
+}
 
 void __cvector_destroy(cvector* v) {
   if (v) {
-    if (v->m_procs) {
-      void (*free_proc)(void*) = v->m_procs->free;
-      free_proc(v->data_ptr);
-      free_proc(v->m_procs);
-      free_proc(v);
-    } else {
-      mem_free(v->data_ptr);
-      mem_free(v);
+    release_the_cvector_data(v);
+    // The procs live in the header, copy them before freeing it.
+    cvector_memmgmt_procs_t procs = v->procs;
+    cvector_memmgmt_procs_t* m_procs = v->custom_procs ? &procs : NULL;
+    // The header of an embedded vector belongs to the caller.
+    if (!v->embedded) {
+      _mem_free(m_procs, v, cvector_header_size(v));
     }
   }
 }
 
+void cvector_deinit(cvector* v) { __cvector_destroy(v); }
+
+bool verify_cvector_growth_policy(const cvector_growth_policy_t* gp,
+                                  char** err) {
+  switch (gp->kind) {
+    case cvec_growth_double:
+    case cvec_growth_one_and_half:
+    case cvec_growth_golden_ratio:
+    case cvec_growth_page:
+      return true;
+    case cvec_growth_custom:
+      if (gp->callback) {
+        return true;
+      }
+      if (err) {
+        *err = CERR_STR("custom growth policy without a callback");
+      }
+      return false;
+  }
+
+  if (err) {
+    *err = CERR_STR("unknown growth policy");
+  }
+  return false;
+}
+
+bool verify_cvector_shrink_policy(const cvector_shrink_policy_t* sp,
+                                  char** err) {
+  switch (sp->kind) {
+    case cvec_shrink_auto:
+    case cvec_shrink_never:
+    case cvec_shrink_hysteresis:
+      // Halving a vector below a lower mark could leave its elements
+      // without room.
+      if (sp->low_water_divisor && sp->low_water_divisor < scaling_factor) {
+        if (err) {
+          *err = CERR_STR("low_water_divisor is less than the scaling factor");
+        }
+        return false;
+      }
+      return true;
+  }
+
+  if (err) {
+    *err = CERR_STR("unknown shrink policy");
+  }
+  return false;
+}
+
 bool verify_cvector_create_inputs(uint32_t elem_size,
                                   cvector_memmgmt_procs_t* mmgt_procs,
                                   char** err) {
@@ -78,8 +123,7 @@ bool verify_cvector_create_inputs(uint32_t elem_size,
     return false;
   }
 
-  if (mmgt_procs && (!mmgt_procs->malloc || !mmgt_procs->calloc ||
-                     !mmgt_procs->realloc || !mmgt_procs->free)) {
+  if (!cvector_mm_procs_valid(mmgt_procs)) {
     if (err) {
       *err = CERR_STR("Detected at least one NULL memory management function");
     }
@@ -89,99 +133,488 @@ bool verify_cvector_create_inputs(uint32_t elem_size,
   return true;
 }
 
-bool populate_mem_mgmt_procs(cvector* cvec,
-                             cvector_memmgmt_procs_t* mmgmt_procs, char** err) {
-  if (mmgmt_procs) {
-    cvec->m_procs = mmgmt_procs->malloc(sizeof(cvector_memmgmt_procs_t));
-    if (!cvec->m_procs) {
+static bool verify_cvector_create_opts(uint32_t elem_size,
+                                       const cvector_create_opts_t* opts,
+                                       char** err) {
+  if (!verify_cvector_create_inputs(elem_size, opts->mmgmt_procs, err) ||
+      !verify_cvector_growth_policy(&opts->growth_policy, err) ||
+      !verify_cvector_shrink_policy(&opts->shrink_policy, err)) {
+    return false;
+  }
+
+  if (opts->snapshot_reads &&
+      (opts->inline_bytes >= elem_size || opts->single_allocation ||
+       opts->mmap_threshold)) {
+    if (err) {
+      *err = CERR_STR("snapshot reads need the data container on the heap");
+    }
+    return false;
+  }
+
+  if (opts->deque &&
+      (opts->inline_bytes >= elem_size || opts->single_allocation ||
+       opts->mmap_threshold || opts->snapshot_reads)) {
+    if (err) {
+      *err = CERR_STR("deques need the data container on the heap");
+    }
+    return false;
+  }
+
+  return true;
+}
+
+// Sets up a zeroed header, allocating the data container unless the
+// elements start in the inline buffer.
+static bool initialize_the_cvector(cvector* v, uint32_t elem_size,
+                                   const cvector_create_opts_t* opts,
+                                   uint32_t inline_capacity, char** err) {
+  cvector_memmgmt_procs_t* mmgt_procs = opts->mmgmt_procs;
+  if (mmgt_procs) {
+    v->procs = *mmgt_procs;
+    v->custom_procs = true;
+  }
+
+  if (inline_capacity) {
+    v->inline_capacity = inline_capacity;
+    v->data_ptr = v->inline_data;
+    v->capacity = inline_capacity;
+  } else if (opts->snapshot_reads) {
+    v->elem_size = elem_size;
+    if (!create_the_cvector_readers(v, minimum_capacity,
+                                    (size_t)minimum_capacity * elem_size)) {
       if (err) {
-        *err = CERR_STR("failed to allocate memory mgmt procs");
+        *err = CERR_STR("failed to allocate data container");
       }
-      mmgmt_procs->free(cvec);
       return false;
     }
-    memcpy(cvec->m_procs, mmgmt_procs, sizeof(cvector_memmgmt_procs_t));
   } else {
-    cvec->m_procs = NULL;
+    v->data_ptr =
+        _mem_alloc(mmgt_procs, (size_t)minimum_capacity * elem_size);
+    if (!v->data_ptr) {
+      if (err) {
+        *err = CERR_STR("failed to allocate data container");
+      }
+      return false;
+    }
+    v->capacity = minimum_capacity;
+  }
+
+  if (err) {
+    *err = NULL;
+  }
+
+  v->elem_count = 0;
+  v->elem_size = elem_size;
+  v->mmap_threshold = opts->mmap_threshold;
+  v->huge_pages = opts->huge_pages;
+  v->deque = opts->deque;
+  v->growth_policy = opts->growth_policy;
+  v->shrink_policy = opts->shrink_policy;
+  if (!v->shrink_policy.low_water_divisor) {
+    v->shrink_policy.low_water_divisor = minimum_capacity;
   }
 
   return true;
 }
 
-cvector* cvector_create_mp(uint32_t elem_size,
-                           cvector_memmgmt_procs_t* mmgt_procs, char** err) {
-  if (!verify_cvector_create_inputs(elem_size, mmgt_procs, err)) {
+cvector* cvector_create_opts(uint32_t elem_size,
+                             const cvector_create_opts_t* opts, char** err) {
+  static const cvector_create_opts_t default_opts = {0};
+  if (!opts) {
+    opts = &default_opts;
+  }
+
+  if (!verify_cvector_create_opts(elem_size, opts, err)) {
     return NULL;
   }
 
+  uint32_t inline_capacity = opts->inline_bytes / elem_size;
+  if (opts->single_allocation && inline_capacity < minimum_capacity) {
+    inline_capacity = minimum_capacity;
+  }
+
+  // Only the struct is zeroed, the inline buffer does not need to be.
+  size_t header_size = sizeof(cvector) + (size_t)inline_capacity * elem_size;
   cvector* v;
-  v = _mem_calloc(mmgt_procs, 1, sizeof(cvector));
+  v = _mem_alloc(opts->mmgmt_procs, header_size);
   if (!v) {
     if (err) {
       *err = CERR_STR("failed to allocate vector container");
     }
     return NULL;
   }
+  memset(v, 0, sizeof(cvector));
 
-  if (!populate_mem_mgmt_procs(v, mmgt_procs, err)) {
+  if (!initialize_the_cvector(v, elem_size, opts, inline_capacity, err)) {
+    _mem_free(opts->mmgmt_procs, v, header_size);
     return NULL;
   }
 
-  v->data_ptr = _mem_alloc(mmgt_procs, minimum_capacity * elem_size);
-  if (!v->data_ptr) {
-    __cvector_destroy(v);
+  return v;
+}
+
+cvector* cvector_init(cvector_storage* storage, uint32_t elem_size,
+                      const cvector_create_opts_t* opts, char** err) {
+  static const cvector_create_opts_t default_opts = {0};
+  if (!opts) {
+    opts = &default_opts;
+  }
+
+  if (!storage) {
     if (err) {
-      *err = CERR_STR("failed to allocate data container");
+      *err = CERR_STR("storage is NULL");
     }
     return NULL;
   }
 
-  if (err) {
-    *err = NULL;
+  if (!verify_cvector_create_opts(elem_size, opts, err)) {
+    return NULL;
   }
 
-  v->capacity = minimum_capacity;
-  v->elem_count = 0;
-  v->elem_size = elem_size;
+  if (opts->inline_bytes >= elem_size || opts->single_allocation) {
+    if (err) {
+      *err = CERR_STR("embedded vectors have no room for inline storage");
+    }
+    return NULL;
+  }
+
+  cvector* v = (cvector*)storage;
+  memset(v, 0, sizeof(cvector));
+  v->embedded = true;
+
+  if (!initialize_the_cvector(v, elem_size, opts, 0, err)) {
+    return NULL;
+  }
 
   return v;
 }
 
+cvector* cvector_create_mp(uint32_t elem_size,
+                           cvector_memmgmt_procs_t* mmgt_procs, char** err) {
+  return cvector_create_opts(
+      elem_size, &(cvector_create_opts_t){.mmgmt_procs = mmgt_procs}, err);
+}
+
+static uint64_t round_up_to_page(uint64_t bytes) {
+  static uint64_t page_size = 0;
+  if (!page_size) {
+    long ps = sysconf(_SC_PAGESIZE);
+    page_size = ps > 0 ? (uint64_t)ps : 4096;
+  }
+
+  return (bytes + page_size - 1) / page_size * page_size;
+}
+
+// The largest element count whose byte size can be allocated at all.
+static inline uint64_t max_capacity(const cvector* v) {
+  return PTRDIFF_MAX / v->elem_size;
+}
+
+// Computes count * elem_size, reporting whether it fits in a size_t.
+static inline bool byte_size(uint64_t count, uint32_t elem_size,
+                             size_t* bytes) {
+  return !__builtin_mul_overflow(count, (uint64_t)elem_size, bytes) &&
+         *bytes <= PTRDIFF_MAX;
+}
+
+// Returns the capacity the vector should grow to in order to hold at least
+// 'required' elements, according to its growth policy. Returns zero if
+// such a capacity can not be represented.
+uint64_t cvector_next_capacity(cvector* v, uint64_t required) {
+  uint64_t limit = max_capacity(v);
+  if (required > limit) {
+    return 0;
+  }
+
+  const cvector_growth_policy_t* gp = &v->growth_policy;
+  uint64_t capacity = v->capacity ? v->capacity : minimum_capacity;
+
+  if (gp->kind == cvec_growth_custom) {
+    capacity = gp->callback(v->capacity, required, gp->args);
+    return (capacity < required || capacity > limit) ? 0 : capacity;
+  }
+
+  // None of the steps below can overflow, capacity * elem_size is known
+  // to fit in PTRDIFF_MAX.
+  while (capacity < required) {
+    uint64_t next;
+    switch (gp->kind) {
+      case cvec_growth_one_and_half:
+        next = capacity + capacity / 2;
+        break;
+      case cvec_growth_golden_ratio:
+        // 1 + 1/2 + 1/8 - 1/128 = 1.6171875
+        next = capacity + capacity / 2 + capacity / 8 - capacity / 128;
+        break;
+      case cvec_growth_page: {
+        uint64_t bytes = capacity * v->elem_size;
+        if (bytes < round_up_to_page(1)) {
+          next = capacity * scaling_factor;
+        } else {
+          next = round_up_to_page(bytes + bytes / 2) / v->elem_size;
+        }
+        break;
+      }
+      default:
+        next = capacity * scaling_factor;
+        break;
+    }
+    capacity = next > capacity ? next : capacity + 1;
+    if (capacity >= limit) {
+      return limit;
+    }
+  }
+
+  return capacity;
+}
+
+// Moves the elements back into the inline buffer once they fit there again.
+static void move_the_cvector_inline(cvector* v) {
+  uint64_t count = v->elem_count < v->inline_capacity ? v->elem_count
+                                                       : v->inline_capacity;
+  memcpy(v->inline_data, v->data_ptr, count * v->elem_size);
+  release_the_cvector_data(v);
+  v->data_ptr = v->inline_data;
+  v->capacity = v->inline_capacity;
+}
+
+// Resizes a mapped data container with mremap, which moves the pages
+// instead of copying them, or maps one and copies the elements over once
+// when the data container was not mapped yet.
+static bool set_the_mapped_capacity(cvector* v, uint64_t new_capacity,
+                                    size_t bytes) {
+  size_t length = round_up_to_page(bytes);
+  void* new_data;
+  if (v->data_is_mapped) {
+    new_data = mremap(v->data_ptr, v->mapped_bytes, length, MREMAP_MAYMOVE);
+    if (new_data == MAP_FAILED) {
+      return false;
+    }
+  } else {
+    new_data = mmap(NULL, length, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (new_data == MAP_FAILED) {
+      return false;
+    }
+    uint64_t count =
+        v->elem_count < new_capacity ? v->elem_count : new_capacity;
+    memcpy(new_data, v->data_ptr, count * v->elem_size);
+    release_the_cvector_data(v);
+  }
+
+  if (v->huge_pages) {
+    // Only a hint, the mapping works without huge pages as well.
+    madvise(new_data, length, MADV_HUGEPAGE);
+  }
+
+  v->data_ptr = new_data;
+  v->data_is_mapped = true;
+  v->mapped_bytes = length;
+  v->capacity = new_capacity;
+  return true;
+}
+
+// Copies the elements of a deque, which may wrap around the end of its data
+// container, to the start of 'dest', in at most two copies.
+static void unwrap_the_deque(const cvector* v, char* dest, uint64_t count) {
+  uint64_t first_part = v->capacity - v->head;
+  if (first_part > count) {
+    first_part = count;
+  }
+  memcpy(dest, (char*)v->data_ptr + v->head * v->elem_size,
+         first_part * v->elem_size);
+  memcpy(dest + first_part * v->elem_size, v->data_ptr,
+         (count - first_part) * v->elem_size);
+}
+
+static bool set_the_deque_capacity(cvector* v, uint64_t new_capacity) {
+  if (new_capacity > ((uint64_t)1 << 63)) {
+    return false;
+  }
+  uint64_t capacity = minimum_capacity;
+  while (capacity < new_capacity) {
+    capacity <<= 1;
+  }
+
+  size_t bytes;
+  if (!byte_size(capacity, v->elem_size, &bytes)) {
+    return false;
+  }
+
+  void* new_data;
+  if (v->head == 0) {
+    new_data = _mem_realloc(cvector_procs(v), v->data_ptr,
+                            cvector_data_size(v), bytes);
+  } else {
+    new_data = _mem_alloc(cvector_procs(v), bytes);
+    if (new_data) {
+      uint64_t count = v->elem_count < capacity ? v->elem_count : capacity;
+      unwrap_the_deque(v, new_data, count);
+      release_the_cvector_data(v);
+    }
+  }
+  if (!new_data) {
+    return false;
+  }
+
+  v->data_ptr = new_data;
+  v->capacity = capacity;
+  v->head = 0;
+  return true;
+}
+
+static void reverse_bytes(char* first, char* last) {
+  while (first < --last) {
+    char c = *first;
+    *first++ = *last;
+    *last = c;
+  }
+}
+
+void linearize_the_cvector(cvector* v) {
+  char* data = v->data_ptr;
+  size_t es = v->elem_size;
+  if (v->head + v->elem_count <= v->capacity) {
+    memmove(data, data + v->head * es, v->elem_count * es);
+  } else if (!set_the_deque_capacity(v, v->capacity)) {
+    // Short of memory for a second buffer, rotate the ring in place.
+    char* end = data + v->capacity * es;
+    reverse_bytes(data, data + v->head * es);
+    reverse_bytes(data + v->head * es, end);
+    reverse_bytes(data, end);
+  }
+  v->head = 0;
+}
+
+bool set_the_cvector_capacity(cvector* v, uint64_t new_capacity) {
+  if (v->deque) {
+    return set_the_deque_capacity(v, new_capacity);
+  }
+
+  if (v->data_is_file) {
+    size_t bytes;
+    return byte_size(new_capacity, v->elem_size, &bytes) &&
+           set_the_file_capacity(v, new_capacity, bytes);
+  }
+
+  // Vectors with inline storage never go below its capacity.
+  if (new_capacity <= v->inline_capacity) {
+    if (!cvector_data_is_inline(v)) {
+      move_the_cvector_inline(v);
+    }
+    return true;
+  }
+
+  size_t bytes;
+  if (!byte_size(new_capacity, v->elem_size, &bytes)) {
+    return false;
+  }
+
+  if (v->readers) {
+    return set_the_snapshot_capacity(v, new_capacity, bytes);
+  }
+
+  if (v->mmap_threshold && bytes >= v->mmap_threshold) {
+    return set_the_mapped_capacity(v, new_capacity, bytes);
+  }
+
+  void* new_data;
+  if (cvector_data_is_inline(v) || v->data_is_mapped) {
+    // Spill over to the heap, or come back to it from a mapping.
+    new_data = _mem_alloc(cvector_procs(v), bytes);
+    if (new_data) {
+      uint64_t count =
+          v->elem_count < new_capacity ? v->elem_count : new_capacity;
+      memcpy(new_data, v->data_ptr, count * v->elem_size);
+      release_the_cvector_data(v);
+    }
+  } else {
+    new_data = _mem_realloc(cvector_procs(v), v->data_ptr,
+                            cvector_data_size(v), bytes);
+  }
+  if (!new_data) {
+    return false;
+  }
+
+  v->data_ptr = new_data;
+  v->capacity = new_capacity;
+  return true;
+}
+
 bool scale_the_cvector_size_up(cvector* v) {
   if (!v) {
     return false;
   }
 
-  void* orig = v->data_ptr;
-  v->data_ptr = _mem_realloc(v->m_procs, v->data_ptr,
-                             scaling_factor * v->capacity * v->elem_size);
-  if (!v->data_ptr) {
-    v->data_ptr = orig;
+  uint64_t new_capacity = cvector_next_capacity(v, v->capacity + 1);
+  if (!new_capacity) {
     return false;
   }
 
-  v->capacity *= scaling_factor;
-  return true;
+  return set_the_cvector_capacity(v, new_capacity);
 }
 
+// Scales the capacity down until the vector is back above its low water
+// mark, in a single step however many elements were removed at once.
 void scale_the_cvector_size_down(cvector* v) {
   if (!v) {
     return;
   }
 
-  if (v->capacity == minimum_capacity) {
+  // Capacities set through cvector_reserve or cvector_shrink_to_fit
+  // are not necessarily multiples of minimum_capacity.
+  uint64_t new_capacity = v->capacity / scaling_factor;
+  while (new_capacity / scaling_factor >= minimum_capacity &&
+         v->elem_count < new_capacity / v->shrink_policy.low_water_divisor) {
+    new_capacity /= scaling_factor;
+  }
+  if (new_capacity < minimum_capacity) {
+    new_capacity = minimum_capacity;
+  }
+  if (new_capacity < v->elem_count) {
+    new_capacity = v->elem_count;
+  }
+
+  if (new_capacity >= v->capacity) {
     return;
   }
 
-  void* orig = v->data_ptr;
-  v->data_ptr = _mem_realloc(v->m_procs, v->data_ptr,
-                             (v->capacity / scaling_factor) * v->elem_size);
-  if (!v->data_ptr) {
-    v->data_ptr = orig;
+  set_the_cvector_capacity(v, new_capacity);
+}
+
+static inline bool below_the_low_water_mark(const cvector* v) {
+  return v->elem_count < v->capacity / v->shrink_policy.low_water_divisor;
+}
+
+// Counts the operations in a row that left the vector below its low water
+// mark, for cvec_shrink_hysteresis.
+static inline void track_the_low_water_streak(cvector* v) {
+  if (v->shrink_policy.kind != cvec_shrink_hysteresis) {
     return;
   }
 
-  v->capacity /= scaling_factor;
+  if (!below_the_low_water_mark(v)) {
+    v->low_water_streak = 0;
+  } else if (v->low_water_streak < UINT32_MAX) {
+    ++v->low_water_streak;
+  }
+}
+
+void shrink_the_cvector_if_needed(cvector* v) {
+  const cvector_shrink_policy_t* sp = &v->shrink_policy;
+  if (sp->kind == cvec_shrink_never) {
+    return;
+  }
+
+  track_the_low_water_streak(v);
+  if (!below_the_low_water_mark(v) ||
+      (sp->kind == cvec_shrink_hysteresis &&
+       v->low_water_streak < sp->hold_ops)) {
+    return;
+  }
+
+  v->low_water_streak = 0;
+  scale_the_cvector_size_down(v);
 }
 
 static inline void assign(void* dest, const void* src, uint32_t size) {
@@ -206,26 +639,88 @@ cvector_retval_t cvector_push_back(cvector* v, const void* new_elem) {
   cvector_retval_t result = cvec_success;
 
   if (v->elem_count < v->capacity) {
-    assign((void*)((unsigned long)v->data_ptr + v->elem_count * v->elem_size),
+    assign((char*)v->data_ptr + cvector_slot(v, v->elem_count) * v->elem_size,
            new_elem, v->elem_size);
-    if (++v->elem_count == v->capacity) {
+    // A full inline buffer only spills over on the next push.
+    if (++v->elem_count == v->capacity && !cvector_data_is_inline(v)) {
       // Ignoring the return value of scale_the_cvector_size_up
       // as we managed to insert the new_elem.
       scale_the_cvector_size_up(v);
     }
   } else {
     if (scale_the_cvector_size_up(v)) {
-      assign((void*)((unsigned long)v->data_ptr + v->elem_count * v->elem_size),
+      assign((char*)v->data_ptr + cvector_slot(v, v->elem_count) * v->elem_size,
              new_elem, v->elem_size);
       ++v->elem_count;
     } else {
       result = cvec_not_enough_memory;
     }
   }
+  track_the_low_water_streak(v);
+  publish_the_cvector(v);
 
   return result;
 }
 
+// Makes sure 'count' more elements fit, leaving the vector untouched on
+// failure.
+static bool make_room_for(cvector* v, uint64_t count) {
+  if (count > max_capacity(v) - v->elem_count) {
+    return false;
+  }
+
+  uint64_t required = v->elem_count + count;
+  if (required > v->capacity ||
+      (required == v->capacity && !cvector_data_is_inline(v))) {
+    // Follow the same growth sequence push_back would have gone through,
+    // but get there with a single reallocation.
+    uint64_t new_capacity = cvector_next_capacity(v, required + 1);
+    if (!new_capacity) {
+      new_capacity = required;
+    }
+
+    if (!set_the_cvector_capacity(v, new_capacity)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+cvector_retval_t cvector_push_back_n64(cvector* v, const void* new_elems,
+                                       uint64_t count) {
+  if (!v || (!new_elems && count > 0)) {
+    return cvec_invalid_arguments;
+  }
+
+  if (count == 0) {
+    return cvec_success;
+  }
+
+  if (!make_room_for(v, count)) {
+    return cvec_not_enough_memory;
+  }
+
+  // The free slots of a deque may wrap around the end of its ring.
+  uint64_t required = v->elem_count + count;
+  uint64_t slot = cvector_slot(v, v->elem_count);
+  uint64_t first_part = v->capacity - slot < count ? v->capacity - slot : count;
+  memcpy((char*)v->data_ptr + slot * v->elem_size, new_elems,
+         first_part * v->elem_size);
+  memcpy(v->data_ptr, (const char*)new_elems + first_part * v->elem_size,
+         (count - first_part) * v->elem_size);
+  v->elem_count = required;
+  track_the_low_water_streak(v);
+  publish_the_cvector(v);
+
+  return cvec_success;
+}
+
+cvector_retval_t cvector_push_back_n(cvector* v, const void* new_elems,
+                                     uint32_t count) {
+  return cvector_push_back_n64(v, new_elems, count);
+}
+
 cvector_retval_t cvector_pop_back(cvector* v, void* target_elem) {
   if (!v || !target_elem) {
     return cvec_invalid_arguments;
@@ -238,19 +733,216 @@ cvector_retval_t cvector_pop_back(cvector* v, void* target_elem) {
     --v->elem_count;
 
     assign(target_elem,
-           (void*)((unsigned long)v->data_ptr + v->elem_count * v->elem_size),
+           (char*)v->data_ptr + cvector_slot(v, v->elem_count) * v->elem_size,
            v->elem_size);
 
-    if (v->elem_count < (v->capacity / minimum_capacity)) {
-      scale_the_cvector_size_down(v);
-    }
+    shrink_the_cvector_if_needed(v);
+    publish_the_cvector(v);
   }
 
   return result;
 }
 
-cvector_retval_t cvector_get_copy_at(cvector* v, uint32_t index,
+cvector_retval_t cvector_push_front(cvector* v, const void* new_elem) {
+  if (!v || !new_elem || !v->deque) {
+    return cvec_invalid_arguments;
+  }
+
+  if (v->elem_count == v->capacity && !scale_the_cvector_size_up(v)) {
+    return cvec_not_enough_memory;
+  }
+
+  v->head = (v->head - 1) & (v->capacity - 1);
+  assign((char*)v->data_ptr + v->head * v->elem_size, new_elem,
+         v->elem_size);
+  ++v->elem_count;
+  track_the_low_water_streak(v);
+
+  return cvec_success;
+}
+
+cvector_retval_t cvector_pop_front(cvector* v, void* target_elem) {
+  if (!v || !target_elem || !v->deque) {
+    return cvec_invalid_arguments;
+  }
+
+  if (v->elem_count == 0) {
+    return cvec_empty;
+  }
+
+  assign(target_elem, (char*)v->data_ptr + v->head * v->elem_size,
+         v->elem_size);
+  v->head = --v->elem_count ? (v->head + 1) & (v->capacity - 1) : 0;
+
+  shrink_the_cvector_if_needed(v);
+
+  return cvec_success;
+}
+
+cvector_retval_t cvector_insert_n_at(cvector* v, uint64_t index,
+                                    const void* new_elems, uint64_t count) {
+  if (!v || (!new_elems && count > 0)) {
+    return cvec_invalid_arguments;
+  }
+
+  if (index > v->elem_count) {
+    return cvec_key_not_found;
+  }
+
+  if (count == 0) {
+    return cvec_success;
+  }
+
+  if (!make_room_for(v, count)) {
+    return cvec_not_enough_memory;
+  }
+
+  cvector_make_contiguous(v);
+  char* pos = (char*)v->data_ptr + index * v->elem_size;
+  memmove(pos + count * v->elem_size, pos,
+          (v->elem_count - index) * v->elem_size);
+  memcpy(pos, new_elems, count * v->elem_size);
+  v->elem_count += count;
+  track_the_low_water_streak(v);
+  publish_the_cvector(v);
+
+  return cvec_success;
+}
+
+cvector_retval_t cvector_insert_at(cvector* v, uint64_t index,
+                                   const void* new_elem) {
+  return cvector_insert_n_at(v, index, new_elem, 1);
+}
+
+cvector_retval_t cvector_erase_range(cvector* v, uint64_t first,
+                                     uint64_t last) {
+  if (!v || first > last) {
+    return cvec_invalid_arguments;
+  }
+
+  if (last > v->elem_count) {
+    return cvec_key_not_found;
+  }
+
+  if (first == last) {
+    return cvec_success;
+  }
+
+  cvector_make_contiguous(v);
+  char* data = (char*)v->data_ptr;
+  memmove(data + first * v->elem_size, data + last * v->elem_size,
+          (v->elem_count - last) * v->elem_size);
+  v->elem_count -= last - first;
+
+  shrink_the_cvector_if_needed(v);
+  publish_the_cvector(v);
+
+  return cvec_success;
+}
+
+cvector_retval_t cvector_erase_if(cvector* v,
+                                  bool (*pred)(const void* elem, void* args),
+                                  void* args) {
+  if (!v || !pred) {
+    return cvec_invalid_arguments;
+  }
+
+  cvector_make_contiguous(v);
+  char* data = (char*)v->data_ptr;
+  size_t es = v->elem_size;
+  uint64_t count = v->elem_count;
+  uint64_t kept = 0;
+  // Survivors are moved a run at a time, once the run ends.
+  uint64_t run_start = 0;
+  for (uint64_t i = 0; i <= count; ++i) {
+    if (i < count && !pred(data + i * es, args)) {
+      continue;
+    }
+
+    if (kept != run_start) {
+      memmove(data + kept * es, data + run_start * es, (i - run_start) * es);
+    }
+    kept += i - run_start;
+    run_start = i + 1;
+  }
+
+  if (kept != count) {
+    v->elem_count = kept;
+    shrink_the_cvector_if_needed(v);
+    publish_the_cvector(v);
+  }
+
+  return cvec_success;
+}
+
+cvector_retval_t cvector_swap_remove(cvector* v, uint64_t index,
                                      void* target_elem) {
+  if (!v) {
+    return cvec_invalid_arguments;
+  }
+
+  if (index >= v->elem_count) {
+    return cvec_key_not_found;
+  }
+
+  cvector_make_contiguous(v);
+  char* elem = (char*)v->data_ptr + index * v->elem_size;
+  if (target_elem) {
+    assign(target_elem, elem, v->elem_size);
+  }
+
+  --v->elem_count;
+  if (index != v->elem_count) {
+    assign(elem, (char*)v->data_ptr + v->elem_count * v->elem_size,
+           v->elem_size);
+  }
+
+  shrink_the_cvector_if_needed(v);
+  publish_the_cvector(v);
+
+  return cvec_success;
+}
+
+cvector_retval_t cvector_swap_remove_n(cvector* v, const uint64_t* indexes,
+                                       uint64_t count) {
+  if (!v || (!indexes && count > 0)) {
+    return cvec_invalid_arguments;
+  }
+
+  if (count == 0) {
+    return cvec_success;
+  }
+
+  for (uint64_t i = 1; i < count; ++i) {
+    if (indexes[i] <= indexes[i - 1]) {
+      return cvec_invalid_arguments;
+    }
+  }
+
+  if (indexes[count - 1] >= v->elem_count) {
+    return cvec_key_not_found;
+  }
+
+  cvector_make_contiguous(v);
+  // Going from the highest index down, the last element is never one that
+  // is about to be removed, so each removal costs at most one move.
+  char* data = (char*)v->data_ptr;
+  for (uint64_t i = count; i-- > 0;) {
+    --v->elem_count;
+    if (indexes[i] != v->elem_count) {
+      assign(data + indexes[i] * v->elem_size,
+             data + v->elem_count * v->elem_size, v->elem_size);
+    }
+  }
+
+  shrink_the_cvector_if_needed(v);
+  publish_the_cvector(v);
+
+  return cvec_success;
+}
+
+cvector_retval_t cvector_get_copy_at64(cvector* v, uint64_t index,
+                                       void* target_elem) {
   if (!v || !target_elem) {
     return cvec_invalid_arguments;
   }
@@ -259,7 +951,7 @@ cvector_retval_t cvector_get_copy_at(cvector* v, uint32_t index,
 
   if (v->elem_count > 0 && index < v->elem_count) {
     assign(target_elem,
-           (void*)((unsigned long)v->data_ptr + index * v->elem_size),
+           (char*)v->data_ptr + cvector_slot(v, index) * v->elem_size,
            v->elem_size);
     result = cvec_success;
   }
@@ -267,8 +959,13 @@ cvector_retval_t cvector_get_copy_at(cvector* v, uint32_t index,
   return result;
 }
 
-cvector_retval_t cvector_get_ptr_at(cvector* v, uint32_t index,
-                                    void** target_elem_ptr) {
+cvector_retval_t cvector_get_copy_at(cvector* v, uint32_t index,
+                                     void* target_elem) {
+  return cvector_get_copy_at64(v, index, target_elem);
+}
+
+cvector_retval_t cvector_get_ptr_at64(cvector* v, uint64_t index,
+                                      void** target_elem_ptr) {
   if (!v || !target_elem_ptr) {
     return cvec_invalid_arguments;
   }
@@ -277,14 +974,23 @@ cvector_retval_t cvector_get_ptr_at(cvector* v, uint32_t index,
 
   if (v->elem_count > 0 && index < v->elem_count) {
     *target_elem_ptr =
-        (void*)((unsigned long)v->data_ptr + index * v->elem_size);
+        (char*)v->data_ptr + cvector_slot(v, index) * v->elem_size;
     result = cvec_success;
   }
 
   return result;
 }
 
-uint32_t cvector_elem_count(cvector* v) {
+cvector_retval_t cvector_get_ptr_at(cvector* v, uint32_t index,
+                                    void** target_elem_ptr) {
+  return cvector_get_ptr_at64(v, index, target_elem_ptr);
+}
+
+static inline uint32_t saturate_to_u32(uint64_t value) {
+  return value > UINT32_MAX ? UINT32_MAX : (uint32_t)value;
+}
+
+uint64_t cvector_elem_count64(cvector* v) {
   if (!v) {
     return 0;
   }
@@ -292,21 +998,80 @@ uint32_t cvector_elem_count(cvector* v) {
   return v->elem_count;
 }
 
+uint32_t cvector_elem_count(cvector* v) {
+  return saturate_to_u32(cvector_elem_count64(v));
+}
+
 void cvector_reset(cvector* v) {
   if (!v) {
     return;
   }
 
-  void* orig = v->data_ptr;
-  v->data_ptr =
-      _mem_realloc(v->m_procs, v->data_ptr, minimum_capacity * v->elem_size);
-  if (!v->data_ptr) {
-    // Capacity should remain unchanged if reallocation fails.
-    v->data_ptr = orig;
-  } else {
-    v->capacity = minimum_capacity;
-  }
+  // Capacity should remain unchanged if reallocation fails.
+  set_the_cvector_capacity(v, minimum_capacity);
   v->elem_count = 0;
+  v->head = 0;
+  publish_the_cvector(v);
+}
+
+uint64_t cvector_capacity64(cvector* v) {
+  if (!v) {
+    return 0;
+  }
+
+  return v->capacity;
+}
+
+uint32_t cvector_capacity(cvector* v) {
+  return saturate_to_u32(cvector_capacity64(v));
+}
+
+cvector_retval_t cvector_reserve64(cvector* v, uint64_t capacity) {
+  if (!v) {
+    return cvec_invalid_arguments;
+  }
+
+  if (capacity >= max_capacity(v)) {
+    return cvec_not_enough_memory;
+  }
+
+  // push_back grows heap buffers as soon as they get full, so one more
+  // slot is needed to store 'capacity' elements without reallocating.
+  uint64_t required = capacity + !cvector_data_is_inline(v);
+  if (required <= v->capacity) {
+    return cvec_success;
+  }
+
+  if (!set_the_cvector_capacity(v, required)) {
+    return cvec_not_enough_memory;
+  }
+
+  return cvec_success;
+}
+
+cvector_retval_t cvector_reserve(cvector* v, uint32_t capacity) {
+  return cvector_reserve64(v, capacity);
+}
+
+cvector_retval_t cvector_shrink_to_fit(cvector* v) {
+  if (!v) {
+    return cvec_invalid_arguments;
+  }
+
+  uint64_t new_capacity = v->elem_count;
+  if (new_capacity < minimum_capacity) {
+    new_capacity = minimum_capacity;
+  }
+
+  if (new_capacity == v->capacity) {
+    return cvec_success;
+  }
+
+  if (!set_the_cvector_capacity(v, new_capacity)) {
+    return cvec_not_enough_memory;
+  }
+
+  return cvec_success;
 }
 
 void cvector_exec_for_each(cvector* v,
@@ -317,21 +1082,65 @@ void cvector_exec_for_each(cvector* v,
     return;
   }
 
+  cvector_make_contiguous(v);
+  unsigned long data_ptr = (unsigned long)v->data_ptr;
+  uint64_t elem_size = v->elem_size;
+  uint64_t elem_count = v->elem_count;
+
+  for (uint64_t i = 0; i < elem_count; ++i) {
+    (*rw_callback)((uint32_t)i, (void*)(data_ptr + i * elem_size), args);
+  }
+}
+
+void cvector_exec_for_each64(cvector* v,
+                             void (*rw_callback)(uint64_t index, void* elem,
+                                                 void* args),
+                             void* args) {
+  if (!v || !rw_callback) {
+    return;
+  }
+
+  cvector_make_contiguous(v);
   unsigned long data_ptr = (unsigned long)v->data_ptr;
-  uint32_t elem_size = v->elem_size;
-  uint32_t elem_count = v->elem_count;
+  uint64_t elem_size = v->elem_size;
+  uint64_t elem_count = v->elem_count;
 
-  for (uint32_t i = 0; i < elem_count; ++i) {
+  for (uint64_t i = 0; i < elem_count; ++i) {
     (*rw_callback)(i, (void*)(data_ptr + i * elem_size), args);
   }
 }
 
+void cvector_exec_for_each_batch(cvector* v,
+                                 void (*batch_callback)(uint64_t start_index,
+                                                        void* elems,
+                                                        uint64_t count,
+                                                        void* args),
+                                 void* args, uint64_t batch_size) {
+  if (!v || !batch_callback) {
+    return;
+  }
+
+  cvector_make_contiguous(v);
+  unsigned long data_ptr = (unsigned long)v->data_ptr;
+  uint64_t elem_size = v->elem_size;
+  uint64_t elem_count = v->elem_count;
+
+  if (batch_size == 0 || batch_size > elem_count) {
+    batch_size = elem_count;
+  }
+
+  for (uint64_t i = 0; i < elem_count; i += batch_size) {
+    uint64_t count = elem_count - i < batch_size ? elem_count - i : batch_size;
+    (*batch_callback)(i, (void*)(data_ptr + i * elem_size), count, args);
+  }
+}
+
 #ifdef RUNNING_UNIT_TESTS
 uint32_t cvector_get_capacity(cvector* v) {
   if (!v) {
     return 0;
   }
 
-  return v->capacity;
+  return saturate_to_u32(v->capacity);
 }
 #endif
@@ -0,0 +1,320 @@
+/*
+MIT License
+
+Copyright (c) 2018 Danis Ozdemir
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "cvector_internal.h"
+
+#include <stddef.h>
+
+// Every block handed out is aligned for any type.
+#define block_alignment _Alignof(max_align_t)
+
+static inline size_t round_up_to_alignment(size_t size) {
+  return (size + block_alignment - 1) & ~(size_t)(block_alignment - 1);
+}
+
+// Arena blocks are 64KiB unless the caller asks otherwise.
+#define default_arena_block_size (64 * 1024)
+
+typedef struct arena_block {
+  struct arena_block* next;
+  size_t size;
+  size_t used;
+  _Alignas(max_align_t) char data[];
+} arena_block;
+
+struct cvector_arena {
+  size_t block_size;
+  // The block allocations are carved from, followed by the older ones.
+  arena_block* head;
+  // The most recent allocation, which can be resized or given back in
+  // place.
+  char* last;
+};
+
+static arena_block* new_arena_block(size_t size) {
+  arena_block* block = mem_alloc(sizeof(arena_block) + size);
+  if (block) {
+    block->next = NULL;
+    block->size = size;
+    block->used = 0;
+  }
+  return block;
+}
+
+static void* arena_malloc(void* ctx, size_t size) {
+  cvector_arena* arena = ctx;
+  size = round_up_to_alignment(size);
+  arena_block* head = arena->head;
+  if (!head || head->size - head->used < size) {
+    head = new_arena_block(size > arena->block_size ? size
+                                                    : arena->block_size);
+    if (!head) {
+      return NULL;
+    }
+    head->next = arena->head;
+    arena->head = head;
+  }
+
+  arena->last = head->data + head->used;
+  head->used += size;
+  return arena->last;
+}
+
+static void* arena_realloc(void* ctx, void* ptr, size_t old_size,
+                           size_t new_size) {
+  cvector_arena* arena = ctx;
+  if (!ptr) {
+    return arena_malloc(arena, new_size);
+  }
+
+  old_size = round_up_to_alignment(old_size);
+  size_t rounded_new_size = round_up_to_alignment(new_size);
+  if (ptr == arena->last) {
+    // The last allocation ends where the free space of the head starts.
+    arena_block* head = arena->head;
+    size_t start = head->used - old_size;
+    if (rounded_new_size <= head->size - start) {
+      head->used = start + rounded_new_size;
+      return ptr;
+    }
+  } else if (rounded_new_size <= old_size) {
+    return ptr;
+  }
+
+  void* new_ptr = arena_malloc(arena, new_size);
+  if (new_ptr) {
+    memcpy(new_ptr, ptr, old_size < new_size ? old_size : new_size);
+  }
+  return new_ptr;
+}
+
+static void arena_free(void* ctx, void* ptr, size_t size) {
+  cvector_arena* arena = ctx;
+  // Only the last allocation can be given back, everything else is
+  // reclaimed by cvector_arena_reset.
+  if (ptr == arena->last) {
+    arena->head->used -= round_up_to_alignment(size);
+    arena->last = NULL;
+  }
+}
+
+cvector_arena* cvector_arena_create(size_t block_size, char** err) {
+  cvector_arena* arena = mem_calloc(1, sizeof(cvector_arena));
+  if (!arena) {
+    if (err) {
+      *err = CERR_STR("failed to allocate the arena");
+    }
+    return NULL;
+  }
+
+  arena->block_size = block_size ? round_up_to_alignment(block_size)
+                                 : default_arena_block_size;
+
+  if (err) {
+    *err = NULL;
+  }
+
+  return arena;
+}
+
+static void free_arena_blocks(arena_block* block) {
+  while (block) {
+    arena_block* next = block->next;
+    mem_free(block);
+    block = next;
+  }
+}
+
+void cvector_arena_reset(cvector_arena* arena) {
+  if (!arena || !arena->head) {
+    return;
+  }
+
+  arena->last = NULL;
+  if (!arena->head->next) {
+    arena->head->used = 0;
+    return;
+  }
+
+  // Replace the blocks with a single one holding all of them, so that an
+  // arena reset between similar workloads settles on one block.
+  size_t total = 0;
+  for (arena_block* block = arena->head; block; block = block->next) {
+    total += block->size;
+  }
+  free_arena_blocks(arena->head);
+  arena->head = new_arena_block(total);
+}
+
+void __cvector_arena_destroy(cvector_arena* arena) {
+  if (arena) {
+    free_arena_blocks(arena->head);
+    mem_free(arena);
+  }
+}
+
+cvector_memmgmt_procs_t cvector_arena_procs(cvector_arena* arena) {
+  return (cvector_memmgmt_procs_t){.ctx = arena,
+                                   .ctx_malloc = arena_malloc,
+                                   .ctx_realloc = arena_realloc,
+                                   .ctx_free = arena_free};
+}
+
+// The pool serves power of two size classes from 16 bytes to 64KiB out of
+// 256KiB slabs, larger blocks go to the standard allocator.
+#define min_class_shift 4
+#define max_class_shift 16
+#define class_count (max_class_shift - min_class_shift + 1)
+#define pool_slab_size (256 * 1024)
+
+typedef struct pool_slab {
+  struct pool_slab* next;
+  _Alignas(max_align_t) char data[];
+} pool_slab;
+
+typedef struct free_block {
+  struct free_block* next;
+} free_block;
+
+struct cvector_pool {
+  free_block* free_lists[class_count];
+  pool_slab* slabs;
+  // The part of the newest slab not handed out yet.
+  char* cursor;
+  size_t slab_left;
+};
+
+static inline uint32_t size_class(size_t size) {
+  if (size <= ((size_t)1 << min_class_shift)) {
+    return 0;
+  }
+  uint32_t shift = 64 - __builtin_clzll((unsigned long long)size - 1);
+  return shift - min_class_shift;
+}
+
+static inline bool is_large(size_t size) {
+  return size > ((size_t)1 << max_class_shift);
+}
+
+static void* pool_malloc(void* ctx, size_t size) {
+  cvector_pool* pool = ctx;
+  if (is_large(size)) {
+    return mem_alloc(size);
+  }
+
+  uint32_t c = size_class(size);
+  free_block* block = pool->free_lists[c];
+  if (block) {
+    pool->free_lists[c] = block->next;
+    return block;
+  }
+
+  size_t class_size = (size_t)1 << (c + min_class_shift);
+  if (pool->slab_left < class_size) {
+    pool_slab* slab = mem_alloc(sizeof(pool_slab) + pool_slab_size);
+    if (!slab) {
+      return NULL;
+    }
+    slab->next = pool->slabs;
+    pool->slabs = slab;
+    pool->cursor = slab->data;
+    pool->slab_left = pool_slab_size;
+  }
+
+  void* ptr = pool->cursor;
+  pool->cursor += class_size;
+  pool->slab_left -= class_size;
+  return ptr;
+}
+
+static void pool_free(void* ctx, void* ptr, size_t size) {
+  cvector_pool* pool = ctx;
+  if (is_large(size)) {
+    mem_free(ptr);
+    return;
+  }
+
+  uint32_t c = size_class(size);
+  free_block* block = ptr;
+  block->next = pool->free_lists[c];
+  pool->free_lists[c] = block;
+}
+
+static void* pool_realloc(void* ctx, void* ptr, size_t old_size,
+                          size_t new_size) {
+  if (!ptr) {
+    return pool_malloc(ctx, new_size);
+  }
+
+  if (is_large(old_size) && is_large(new_size)) {
+    return mem_realloc(ptr, new_size);
+  }
+
+  if (!is_large(old_size) && !is_large(new_size) &&
+      size_class(old_size) == size_class(new_size)) {
+    return ptr;
+  }
+
+  void* new_ptr = pool_malloc(ctx, new_size);
+  if (new_ptr) {
+    memcpy(new_ptr, ptr, old_size < new_size ? old_size : new_size);
+    pool_free(ctx, ptr, old_size);
+  }
+  return new_ptr;
+}
+
+cvector_pool* cvector_pool_create(char** err) {
+  cvector_pool* pool = mem_calloc(1, sizeof(cvector_pool));
+  if (!pool) {
+    if (err) {
+      *err = CERR_STR("failed to allocate the pool");
+    }
+    return NULL;
+  }
+
+  if (err) {
+    *err = NULL;
+  }
+
+  return pool;
+}
+
+void __cvector_pool_destroy(cvector_pool* pool) {
+  if (pool) {
+    pool_slab* slab = pool->slabs;
+    while (slab) {
+      pool_slab* next = slab->next;
+      mem_free(slab);
+      slab = next;
+    }
+    mem_free(pool);
+  }
+}
+
+cvector_memmgmt_procs_t cvector_pool_procs(cvector_pool* pool) {
+  return (cvector_memmgmt_procs_t){.ctx = pool,
+                                   .ctx_malloc = pool_malloc,
+                                   .ctx_realloc = pool_realloc,
+                                   .ctx_free = pool_free};
+}
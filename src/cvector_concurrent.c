@@ -0,0 +1,408 @@
+/*
+MIT License
+
+Copyright (c) 2018 Danis Ozdemir
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "cvector_internal.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+struct cvector_concurrent {
+  uint32_t elem_size;
+  cvector_memmgmt_procs_t* m_procs;
+  cvector_memmgmt_procs_t procs;
+  // Taken to allocate segments only, the fast path never touches it.
+  pthread_mutex_t grow_lock;
+  // Each segment holds its elements followed by one ready flag per element,
+  // set once the element is written.
+  _Atomic(char*) segments[CVEC_MAX_SEGMENTS];
+  atomic_bool failed;
+  // Kept on cache lines of their own, as every producer updates them.
+  // Slots below 'claimed' are handed out, elements below 'published' are
+  // written.
+  _Alignas(CVEC_CACHE_LINE_SIZE) atomic_uint_fast64_t claimed;
+  _Alignas(CVEC_CACHE_LINE_SIZE) atomic_uint_fast64_t published;
+};
+
+cvector_concurrent* cvector_concurrent_create(
+    uint32_t elem_size, cvector_memmgmt_procs_t* mmgt_procs, char** err) {
+  if (elem_size == 0) {
+    if (err) {
+      *err = CERR_STR("elem_size is zero");
+    }
+    return NULL;
+  }
+
+  if (!cvector_mm_procs_valid(mmgt_procs)) {
+    if (err) {
+      *err = CERR_STR("Detected at least one NULL memory management function");
+    }
+    return NULL;
+  }
+
+  cvector_concurrent* v =
+      cvector_aligned_alloc(mmgt_procs, sizeof(cvector_concurrent));
+  if (!v) {
+    if (err) {
+      *err = CERR_STR("failed to allocate vector container");
+    }
+    return NULL;
+  }
+
+  memset(v, 0, sizeof(*v));
+  v->elem_size = elem_size;
+  if (mmgt_procs) {
+    v->procs = *mmgt_procs;
+    v->m_procs = &v->procs;
+  }
+  pthread_mutex_init(&v->grow_lock, NULL);
+  for (uint32_t i = 0; i < CVEC_MAX_SEGMENTS; ++i) {
+    atomic_init(&v->segments[i], NULL);
+  }
+  atomic_init(&v->failed, false);
+  atomic_init(&v->claimed, 0);
+  atomic_init(&v->published, 0);
+
+  if (err) {
+    *err = NULL;
+  }
+
+  return v;
+}
+
+static size_t segment_bytes(const cvector_concurrent* v, uint32_t segment) {
+  size_t bytes;
+  if (__builtin_mul_overflow(cvector_segment_capacity(segment),
+                             (uint64_t)v->elem_size + 1, &bytes) ||
+      bytes > PTRDIFF_MAX) {
+    return 0;
+  }
+  return bytes;
+}
+
+static atomic_uchar* ready_flags(const cvector_concurrent* v, char* data,
+                                 uint32_t segment) {
+  return (atomic_uchar*)(data + cvector_segment_capacity(segment) *
+                                    v->elem_size);
+}
+
+void __cvector_concurrent_destroy(cvector_concurrent* v) {
+  if (!v) {
+    return;
+  }
+
+  for (uint32_t i = 0; i < CVEC_MAX_SEGMENTS; ++i) {
+    char* segment = atomic_load_explicit(&v->segments[i],
+                                         memory_order_relaxed);
+    _mem_free(v->m_procs, segment, segment_bytes(v, i));
+  }
+  pthread_mutex_destroy(&v->grow_lock);
+  // The procs live in the header, copy them before freeing it.
+  cvector_memmgmt_procs_t procs = v->procs;
+  cvector_aligned_free(v->m_procs ? &procs : NULL, v,
+                       sizeof(cvector_concurrent));
+}
+
+// Returns the segment, allocating it unless some other thread already did.
+static char* get_segment(cvector_concurrent* v, uint32_t segment) {
+  char* data = atomic_load_explicit(&v->segments[segment],
+                                    memory_order_acquire);
+  if (data) {
+    return data;
+  }
+
+  pthread_mutex_lock(&v->grow_lock);
+  data = atomic_load_explicit(&v->segments[segment], memory_order_relaxed);
+  if (!data) {
+    size_t bytes = segment_bytes(v, segment);
+    data = bytes ? _mem_alloc(v->m_procs, bytes) : NULL;
+    if (data) {
+      memset(ready_flags(v, data, segment), 0,
+             cvector_segment_capacity(segment));
+      atomic_store_explicit(&v->segments[segment], data,
+                            memory_order_release);
+    }
+  }
+  pthread_mutex_unlock(&v->grow_lock);
+
+  return data;
+}
+
+cvector_retval_t cvector_concurrent_reserve(cvector_concurrent* v,
+                                            uint64_t capacity) {
+  if (!v) {
+    return cvec_invalid_arguments;
+  }
+
+  if (capacity == 0) {
+    return cvec_success;
+  }
+
+  if (capacity > CVEC_MAX_SEGMENTED_COUNT) {
+    return cvec_not_enough_memory;
+  }
+
+  uint64_t offset;
+  uint32_t last = cvector_segment_of(capacity - 1, &offset);
+  for (uint32_t i = 0; i <= last; ++i) {
+    if (!get_segment(v, i)) {
+      return cvec_not_enough_memory;
+    }
+  }
+
+  return cvec_success;
+}
+
+// Copies the elements into the slots starting at 'first', which may span
+// several segments.
+static bool copy_slots(cvector_concurrent* v, uint64_t first,
+                       const char* src, uint64_t count) {
+  while (count > 0) {
+    uint64_t offset;
+    uint32_t segment = cvector_segment_of(first, &offset);
+    char* data = get_segment(v, segment);
+    if (!data) {
+      return false;
+    }
+
+    uint64_t n = cvector_segment_capacity(segment) - offset;
+    if (n > count) {
+      n = count;
+    }
+    memcpy(data + offset * v->elem_size, src, n * v->elem_size);
+    src += n * v->elem_size;
+    first += n;
+    count -= n;
+  }
+
+  return true;
+}
+
+// Flags the copied elements as ready.
+static void flag_slots(cvector_concurrent* v, uint64_t first,
+                       uint64_t count) {
+  while (count > 0) {
+    uint64_t offset;
+    uint32_t segment = cvector_segment_of(first, &offset);
+    char* data =
+        atomic_load_explicit(&v->segments[segment], memory_order_relaxed);
+    atomic_uchar* ready = ready_flags(v, data, segment);
+    uint64_t n = cvector_segment_capacity(segment) - offset;
+    if (n > count) {
+      n = count;
+    }
+    for (uint64_t i = offset; i < offset + n; ++i) {
+      atomic_store_explicit(&ready[i], 1, memory_order_release);
+    }
+    first += n;
+    count -= n;
+  }
+}
+
+// Returns the end of the run of ready elements starting at 'first'.
+static uint64_t ready_end(cvector_concurrent* v, uint64_t first) {
+  uint64_t end = first;
+  while (end < CVEC_MAX_SEGMENTED_COUNT) {
+    uint64_t offset;
+    uint32_t segment = cvector_segment_of(end, &offset);
+    char* data = atomic_load(&v->segments[segment]);
+    if (!data) {
+      break;
+    }
+
+    atomic_uchar* ready = ready_flags(v, data, segment);
+    uint64_t capacity = cvector_segment_capacity(segment);
+    uint64_t i = offset;
+    while (i < capacity && atomic_load(&ready[i])) {
+      ++i;
+    }
+    end += i - offset;
+    if (i < capacity) {
+      break;
+    }
+  }
+
+  return end;
+}
+
+// Moves the published count past the ready elements following 'published',
+// so no producer ever waits for another. Callers either just moved the
+// count themselves or flagged their elements and went through a
+// sequentially consistent fence, and whoever moves the count looks at the
+// flags following it again. All of that in sequentially consistent order,
+// of two producers racing over neighbouring elements, at least one hence
+// sees the other's flags or count.
+static void advance_published(cvector_concurrent* v, uint64_t published) {
+  for (;;) {
+    uint64_t end = ready_end(v, published);
+    if (end == published) {
+      return;
+    }
+
+    if (atomic_compare_exchange_strong(&v->published, &published, end)) {
+      published = end;
+    }
+  }
+}
+
+cvector_retval_t cvector_concurrent_push_back_n(cvector_concurrent* v,
+                                                const void* new_elems,
+                                                uint64_t count,
+                                                uint64_t* first_index) {
+  if (!v || !new_elems) {
+    return cvec_invalid_arguments;
+  }
+
+  if (count == 0) {
+    if (first_index) {
+      *first_index = cvector_concurrent_elem_count(v);
+    }
+    return cvec_success;
+  }
+
+  if (atomic_load_explicit(&v->failed, memory_order_relaxed)) {
+    return cvec_not_enough_memory;
+  }
+
+  if (count > CVEC_MAX_SEGMENTED_COUNT) {
+    return cvec_not_enough_memory;
+  }
+
+  // Checking the headroom before claiming keeps a run that does not fit
+  // from leaving a hole no one will ever fill.
+  uint64_t first = atomic_load_explicit(&v->claimed, memory_order_relaxed);
+  do {
+    if (first > CVEC_MAX_SEGMENTED_COUNT - count) {
+      return cvec_not_enough_memory;
+    }
+  } while (!atomic_compare_exchange_weak_explicit(
+      &v->claimed, &first, first + count, memory_order_relaxed,
+      memory_order_relaxed));
+
+  if (!copy_slots(v, first, new_elems, count)) {
+    atomic_store_explicit(&v->failed, true, memory_order_relaxed);
+    return cvec_not_enough_memory;
+  }
+
+  // When every earlier element is published, as is always the case
+  // without contention, nobody else can move the count, so publishing
+  // takes a single compare and swap and no flags. There is nothing to
+  // look for past them either, unless someone claimed more slots since.
+  uint64_t published =
+      atomic_load_explicit(&v->published, memory_order_relaxed);
+  if (published == first &&
+      atomic_compare_exchange_strong(&v->published, &published,
+                                     first + count)) {
+    if (atomic_load(&v->claimed) != first + count) {
+      advance_published(v, first + count);
+    }
+  } else {
+    flag_slots(v, first, count);
+    atomic_thread_fence(memory_order_seq_cst);
+    advance_published(
+        v, atomic_load_explicit(&v->published, memory_order_relaxed));
+  }
+
+  if (first_index) {
+    *first_index = first;
+  }
+
+  return cvec_success;
+}
+
+cvector_retval_t cvector_concurrent_push_back(cvector_concurrent* v,
+                                              const void* new_elem,
+                                              uint64_t* index) {
+  return cvector_concurrent_push_back_n(v, new_elem, 1, index);
+}
+
+uint64_t cvector_concurrent_elem_count(cvector_concurrent* v) {
+  if (!v) {
+    return 0;
+  }
+
+  return atomic_load_explicit(&v->published, memory_order_acquire);
+}
+
+cvector_retval_t cvector_concurrent_get_ptr_at(cvector_concurrent* v,
+                                               uint64_t index,
+                                               void** target_elem_ptr) {
+  if (!v || !target_elem_ptr) {
+    return cvec_invalid_arguments;
+  }
+
+  if (index >= atomic_load_explicit(&v->published, memory_order_acquire)) {
+    return cvec_key_not_found;
+  }
+
+  uint64_t offset;
+  uint32_t segment = cvector_segment_of(index, &offset);
+  char* data = atomic_load_explicit(&v->segments[segment],
+                                    memory_order_relaxed);
+  *target_elem_ptr = data + offset * v->elem_size;
+
+  return cvec_success;
+}
+
+cvector_retval_t cvector_concurrent_get_copy_at(cvector_concurrent* v,
+                                                uint64_t index,
+                                                void* target_elem) {
+  if (!target_elem) {
+    return cvec_invalid_arguments;
+  }
+
+  void* elem;
+  cvector_retval_t result = cvector_concurrent_get_ptr_at(v, index, &elem);
+  if (result != cvec_success) {
+    return result;
+  }
+
+  memcpy(target_elem, elem, v->elem_size);
+
+  return cvec_success;
+}
+
+void cvector_concurrent_exec_for_each(
+    cvector_concurrent* v,
+    void (*read_write_callback)(uint64_t index, void* elem, void* args),
+    void* args) {
+  if (!v || !read_write_callback) {
+    return;
+  }
+
+  uint64_t count = cvector_concurrent_elem_count(v);
+  uint64_t index = 0;
+  for (uint32_t segment = 0; index < count; ++segment) {
+    char* data = atomic_load_explicit(&v->segments[segment],
+                                      memory_order_relaxed);
+    uint64_t end = cvector_segment_start(segment) +
+                   cvector_segment_capacity(segment);
+    if (end > count) {
+      end = count;
+    }
+    for (; index < end; ++index) {
+      read_write_callback(index, data, args);
+      data += v->elem_size;
+    }
+  }
+}
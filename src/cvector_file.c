@@ -0,0 +1,370 @@
+/*
+MIT License
+
+Copyright (c) 2018 Danis Ozdemir
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "cvector_internal.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#define file_magic "CVECTOR"
+#define file_version 1
+// Written in native byte order, so that files from a machine of the other
+// endianness are recognized.
+#define byte_order_mark 0x01020304u
+// The data container starts on its own page, right after the header.
+#define file_data_offset 4096
+
+typedef struct file_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;
+  uint32_t elem_size;
+  uint32_t reserved;
+  uint64_t data_offset;
+  uint64_t elem_count;
+  uint64_t capacity;
+  // FNV-1a hash of all the fields above.
+  uint64_t checksum;
+} file_header;
+
+static uint64_t header_checksum(const file_header* h) {
+  const unsigned char* bytes = (const unsigned char*)h;
+  uint64_t hash = 0xcbf29ce484222325ull;
+  for (size_t i = 0; i < offsetof(file_header, checksum); ++i) {
+    hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+  }
+  return hash;
+}
+
+static inline file_header* header_of(cvector* v) {
+  return (file_header*)((char*)v->data_ptr - file_data_offset);
+}
+
+static void write_file_header(cvector* v) {
+  file_header* h = header_of(v);
+  h->elem_count = v->elem_count < v->capacity ? v->elem_count : v->capacity;
+  h->capacity = v->capacity;
+  h->checksum = header_checksum(h);
+}
+
+bool set_the_file_capacity(cvector* v, uint64_t new_capacity, size_t bytes) {
+  size_t length;
+  if (__builtin_add_overflow(bytes, (size_t)file_data_offset, &length)) {
+    return false;
+  }
+
+  // The file is extended before the mapping grows over it, and shrunk
+  // after the mapping stops covering the tail.
+  if (length > v->mapped_bytes && ftruncate(v->fd, length) != 0) {
+    return false;
+  }
+
+  char* map = mremap(header_of(v), v->mapped_bytes, length, MREMAP_MAYMOVE);
+  if (map == MAP_FAILED) {
+    if (length > v->mapped_bytes) {
+      ftruncate(v->fd, v->mapped_bytes);
+    }
+    return false;
+  }
+
+  if (length < v->mapped_bytes) {
+    // A failure only leaves unused bytes at the end of the file.
+    ftruncate(v->fd, length);
+  }
+
+  v->data_ptr = map + file_data_offset;
+  v->mapped_bytes = length;
+  v->capacity = new_capacity;
+  write_file_header(v);
+  return true;
+}
+
+void close_the_cvector_file(cvector* v) {
+  write_file_header(v);
+  munmap(header_of(v), v->mapped_bytes);
+  close(v->fd);
+  v->data_is_file = false;
+}
+
+static bool verify_file_header(const file_header* h, uint32_t elem_size,
+                               uint64_t file_size, char** err) {
+  const char* problem = NULL;
+  size_t data_bytes;
+  if (memcmp(h->magic, file_magic, sizeof(h->magic)) != 0) {
+    problem = CERR_STR("not a cvector file");
+  } else if (h->version != file_version) {
+    problem = CERR_STR("unsupported cvector file version");
+  } else if (h->byte_order != byte_order_mark) {
+    problem = CERR_STR("cvector file of the other byte order");
+  } else if (h->checksum != header_checksum(h)) {
+    problem = CERR_STR("corrupted cvector file header");
+  } else if (h->elem_size != elem_size) {
+    problem = CERR_STR("elem_size does not match the cvector file");
+  } else if (h->data_offset != file_data_offset ||
+             h->elem_count > h->capacity ||
+             __builtin_mul_overflow(h->capacity, (uint64_t)elem_size,
+                                    &data_bytes) ||
+             file_size < file_data_offset ||
+             file_size - file_data_offset < data_bytes) {
+    problem = CERR_STR("inconsistent cvector file header");
+  }
+
+  if (problem && err) {
+    *err = (char*)problem;
+  }
+  return !problem;
+}
+
+cvector* cvector_open_file(const char* path, uint32_t elem_size,
+                           uint32_t flags, char** err) {
+  if (!path || elem_size == 0) {
+    if (err) {
+      *err = CERR_STR("path is NULL or elem_size is zero");
+    }
+    return NULL;
+  }
+
+  int open_flags = O_RDWR | O_CLOEXEC;
+  if (flags & cvec_file_create) {
+    open_flags |= O_CREAT;
+  }
+  if (flags & cvec_file_truncate) {
+    open_flags |= O_TRUNC;
+  }
+
+  int fd = open(path, open_flags, 0644);
+  if (fd < 0) {
+    if (err) {
+      *err = CERR_STR("failed to open the file");
+    }
+    return NULL;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    if (err) {
+      *err = CERR_STR("failed to stat the file");
+    }
+    return NULL;
+  }
+
+  // An empty file gets a fresh header, any other one must carry a valid
+  // header, in which case its elements are used as they are.
+  file_header h = {0};
+  size_t length;
+  if (st.st_size == 0) {
+    memcpy(h.magic, file_magic, sizeof(h.magic));
+    h.version = file_version;
+    h.byte_order = byte_order_mark;
+    h.elem_size = elem_size;
+    h.data_offset = file_data_offset;
+    h.capacity = minimum_capacity;
+    length = file_data_offset + (size_t)minimum_capacity * elem_size;
+    if (ftruncate(fd, length) != 0) {
+      close(fd);
+      if (err) {
+        *err = CERR_STR("failed to extend the file");
+      }
+      return NULL;
+    }
+  } else {
+    if (pread(fd, &h, sizeof(h), 0) != (ssize_t)sizeof(h)) {
+      memset(&h, 0, sizeof(h));
+    }
+    if (!verify_file_header(&h, elem_size, st.st_size, err)) {
+      close(fd);
+      return NULL;
+    }
+    length = file_data_offset + h.capacity * elem_size;
+  }
+
+  char* map = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED) {
+    close(fd);
+    if (err) {
+      *err = CERR_STR("failed to map the file");
+    }
+    return NULL;
+  }
+
+  cvector* v = mem_alloc(sizeof(cvector));
+  if (!v) {
+    munmap(map, length);
+    close(fd);
+    if (err) {
+      *err = CERR_STR("failed to allocate vector container");
+    }
+    return NULL;
+  }
+  memset(v, 0, sizeof(cvector));
+
+  v->elem_size = elem_size;
+  v->elem_count = h.elem_count;
+  v->capacity = h.capacity;
+  v->data_ptr = map + file_data_offset;
+  v->data_is_file = true;
+  v->fd = fd;
+  v->mapped_bytes = length;
+  v->shrink_policy.low_water_divisor = minimum_capacity;
+
+  memcpy(map, &h, sizeof(h));
+  write_file_header(v);
+
+  if (err) {
+    *err = NULL;
+  }
+
+  return v;
+}
+
+cvector_retval_t cvector_sync(cvector* v) {
+  if (!v || !v->data_is_file) {
+    return cvec_invalid_arguments;
+  }
+
+  write_file_header(v);
+  // Only the pages written since the last flush reach the disk.
+  if (msync(header_of(v), v->mapped_bytes, MS_SYNC) != 0) {
+    return cvec_io_error;
+  }
+
+  return cvec_success;
+}
+
+#define stream_magic "CVECSTRM"
+#define stream_version 1
+
+// Precedes the elements in the streams cvector_write_fd produces.
+typedef struct stream_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;
+  uint32_t elem_size;
+  uint32_t reserved;
+  uint64_t elem_count;
+} stream_header;
+
+cvector_retval_t cvector_write_fd(cvector* v, int fd) {
+  if (!v || fd < 0) {
+    return cvec_invalid_arguments;
+  }
+
+  cvector_make_contiguous(v);
+  stream_header h = {.version = stream_version,
+                     .byte_order = byte_order_mark,
+                     .elem_size = v->elem_size,
+                     .elem_count = v->elem_count};
+  memcpy(h.magic, stream_magic, sizeof(h.magic));
+
+  // The elements go out straight from the data container, along with the
+  // header in the same system call.
+  struct iovec iov[2] = {
+      {.iov_base = &h, .iov_len = sizeof(h)},
+      {.iov_base = v->data_ptr, .iov_len = v->elem_count * v->elem_size}};
+  struct iovec* next = iov;
+  int left = 2;
+  while (left > 0) {
+    ssize_t written = writev(fd, next, left);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return cvec_io_error;
+    }
+
+    // Skip whatever a partial write managed to get through.
+    size_t done = (size_t)written;
+    while (left > 0 && done >= next->iov_len) {
+      done -= next->iov_len;
+      ++next;
+      --left;
+    }
+    if (left > 0) {
+      next->iov_base = (char*)next->iov_base + done;
+      next->iov_len -= done;
+    }
+  }
+
+  return cvec_success;
+}
+
+static bool read_fully(int fd, void* buf, size_t size) {
+  char* pos = buf;
+  while (size > 0) {
+    ssize_t n = read(fd, pos, size);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    pos += n;
+    size -= (size_t)n;
+  }
+  return true;
+}
+
+cvector_retval_t cvector_read_fd(cvector* v, int fd) {
+  if (!v || fd < 0) {
+    return cvec_invalid_arguments;
+  }
+
+  stream_header h;
+  if (!read_fully(fd, &h, sizeof(h)) ||
+      memcmp(h.magic, stream_magic, sizeof(h.magic)) != 0 ||
+      h.version != stream_version || h.byte_order != byte_order_mark) {
+    return cvec_io_error;
+  }
+
+  if (h.elem_size != v->elem_size) {
+    return cvec_invalid_arguments;
+  }
+
+  if (h.elem_count > UINT64_MAX - v->elem_count) {
+    return cvec_not_enough_memory;
+  }
+
+  cvector_retval_t result = cvector_reserve64(v, v->elem_count + h.elem_count);
+  if (result != cvec_success) {
+    return result;
+  }
+  cvector_make_contiguous(v);
+
+  // Only counted in once they are all there.
+  if (!read_fully(fd, (char*)v->data_ptr + v->elem_count * v->elem_size,
+                  h.elem_count * v->elem_size)) {
+    return cvec_io_error;
+  }
+  v->elem_count += h.elem_count;
+  publish_the_cvector(v);
+
+  return cvec_success;
+}
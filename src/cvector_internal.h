@@ -0,0 +1,256 @@
+/*
+MIT License
+
+Copyright (c) 2018 Danis Ozdemir
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// Definitions shared by the translation units of the library, not to be
+// included by users.
+
+#pragma once
+
+#include <cvector.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define mem_alloc(size) malloc(size)
+#define mem_calloc(elem_count, elem_size) calloc(elem_count, elem_size)
+#define mem_realloc(ptr, new_size) realloc(ptr, new_size)
+#define mem_free(ptr) free(ptr)
+
+// The sizes are the ones the block was allocated with, as the context
+// carrying procedures need them.
+#define _mem_alloc(m_procs, size) cvector_mm_alloc(m_procs, size)
+#define _mem_realloc(m_procs, ptr, old_size, new_size) \
+  cvector_mm_realloc(m_procs, ptr, old_size, new_size)
+#define _mem_free(m_procs, ptr, size) cvector_mm_free(m_procs, ptr, size)
+
+#define stringify(s) #s
+#define x_stringify(s) stringify(s)
+#define CERR_STR(x) (__FILE__ ":" x_stringify(__LINE__) " - " x)
+
+#define CVEC_CACHE_LINE_SIZE 64
+
+// Allocates a cache line aligned block from the memory management procs,
+// which only promise the alignment of max_align_t. The block is a cache
+// line larger than asked for, and the byte right before the aligned
+// pointer holds its distance from the start of the block.
+static inline void* cvector_aligned_alloc(cvector_memmgmt_procs_t* m_procs,
+                                          size_t size) {
+  char* block = _mem_alloc(m_procs, size + CVEC_CACHE_LINE_SIZE);
+  if (!block) {
+    return NULL;
+  }
+  char* aligned =
+      (char*)(((uintptr_t)block + CVEC_CACHE_LINE_SIZE) &
+              ~(uintptr_t)(CVEC_CACHE_LINE_SIZE - 1));
+  aligned[-1] = (char)(aligned - block);
+  return aligned;
+}
+
+// Frees a block cvector_aligned_alloc returned for 'size' bytes.
+static inline void cvector_aligned_free(cvector_memmgmt_procs_t* m_procs,
+                                        void* ptr, size_t size) {
+  if (ptr) {
+    char* aligned = ptr;
+    _mem_free(m_procs, aligned - (unsigned char)aligned[-1],
+              size + CVEC_CACHE_LINE_SIZE);
+  }
+}
+
+extern const uint32_t minimum_capacity;
+extern const uint32_t scaling_factor;
+
+// Reader slots and retired data containers of the vectors created with
+// snapshot_reads, see cvector_snapshot.c.
+typedef struct cvector_readers cvector_readers;
+
+struct cvector {
+  uint32_t elem_size;
+  // The file behind the data of the vectors cvector_open_file returns.
+  int fd;
+  uint64_t elem_count;
+  uint64_t capacity;
+  // Only used when custom_procs is set, see cvector_procs.
+  cvector_memmgmt_procs_t procs;
+  void* data_ptr;
+  cvector_growth_policy_t growth_policy;
+  cvector_shrink_policy_t shrink_policy;
+  // Number of operations in a row, pushes and pops alike, that left the
+  // vector below its low water mark, used by cvec_shrink_hysteresis.
+  uint32_t low_water_streak;
+  // Number of elements fitting in inline_data, zero if the vector was
+  // created without inline storage.
+  uint32_t inline_capacity;
+  // Set for vectors created with custom memory management procedures.
+  bool custom_procs;
+  // Set for vectors living in a caller owned cvector_storage.
+  bool embedded;
+  // Set while the data container is an anonymous mapping of mapped_bytes
+  // bytes rather than a block from the memory management procs.
+  bool data_is_mapped;
+  bool huge_pages;
+  // Set for vectors opened by cvector_open_file, whose data container
+  // follows a header in a shared mapping of mapped_bytes bytes of 'fd'.
+  bool data_is_file;
+  // Set for vectors created in deque mode, whose elements live in a ring
+  // of a power of two capacity, the first one at index 'head'.
+  bool deque;
+  size_t mapped_bytes;
+  // Data containers of at least that many bytes are mapped, zero never
+  // maps them.
+  uint64_t mmap_threshold;
+  // Set for vectors created with snapshot_reads, whose data containers are
+  // only freed once no reader can be looking at them.
+  cvector_readers* readers;
+  uint64_t head;
+  // Small buffer the elements live in until they outgrow it, allocated
+  // together with the struct.
+  _Alignas(max_align_t) char inline_data[];
+};
+
+// The memory management procedures of the vector, NULL for the standard
+// ones. Not kept as a pointer into the header, which would dangle once an
+// embedded header is moved.
+static inline cvector_memmgmt_procs_t* cvector_procs(cvector* v) {
+  return v->custom_procs ? &v->procs : NULL;
+}
+
+static inline bool cvector_data_is_inline(const cvector* v) {
+  return v->inline_capacity && v->data_ptr == v->inline_data;
+}
+
+// Index in the data container of the element at logical 'index'.
+static inline uint64_t cvector_slot(const cvector* v, uint64_t index) {
+  return v->deque ? (v->head + index) & (v->capacity - 1) : index;
+}
+
+// Moves the elements of a deque to the start of its data container,
+// implemented by cvector.c.
+void linearize_the_cvector(cvector* v);
+
+// Called by the operations that need the elements to be contiguous and to
+// start at data_ptr, which only deques may not satisfy.
+static inline void cvector_make_contiguous(cvector* v) {
+  if (v->head) {
+    linearize_the_cvector(v);
+  }
+}
+
+// Sizes of the blocks the vector allocated, the data container one only
+// meaning anything when the data is not inline.
+static inline size_t cvector_header_size(const cvector* v) {
+  return sizeof(cvector) + (size_t)v->inline_capacity * v->elem_size;
+}
+
+static inline size_t cvector_data_size(const cvector* v) {
+  return v->capacity * v->elem_size;
+}
+
+// Implemented by cvector_file.c for the vectors cvector_open_file returns.
+bool set_the_file_capacity(cvector* v, uint64_t new_capacity, size_t bytes);
+void close_the_cvector_file(cvector* v);
+
+// Implemented by cvector_snapshot.c for the vectors created with
+// snapshot_reads. Their data containers are always replaced rather than
+// reallocated, the old ones being retired until the readers are done.
+bool create_the_cvector_readers(cvector* v, uint64_t capacity, size_t bytes);
+bool set_the_snapshot_capacity(cvector* v, uint64_t new_capacity,
+                               size_t bytes);
+void destroy_the_cvector_readers(cvector* v);
+void publish_the_snapshot_count(cvector* v);
+
+// Makes the element count visible to snapshot readers, called by every
+// operation changing it once the elements are in place.
+static inline void publish_the_cvector(cvector* v) {
+  if (v->readers) {
+    publish_the_snapshot_count(v);
+  }
+}
+
+// Reads the unsigned integer key of 'key_size' bytes used by the *_by_key
+// functions, 'key_size' being one of 1, 2, 4 or 8.
+static inline uint64_t cvector_read_key(const char* key_ptr,
+                                        uint32_t key_size) {
+  switch (key_size) {
+    case 1:
+      return *(const uint8_t*)key_ptr;
+    case 2: {
+      uint16_t k;
+      memcpy(&k, key_ptr, sizeof(k));
+      return k;
+    }
+    case 4: {
+      uint32_t k;
+      memcpy(&k, key_ptr, sizeof(k));
+      return k;
+    }
+    default: {
+      uint64_t k;
+      memcpy(&k, key_ptr, sizeof(k));
+      return k;
+    }
+  }
+}
+
+static inline bool cvector_valid_key(const cvector* v, uint32_t key_offset,
+                                     uint32_t key_size) {
+  return (key_size == 1 || key_size == 2 || key_size == 4 || key_size == 8) &&
+         (uint64_t)key_offset + key_size <= v->elem_size;
+}
+
+// Segmented storage, used by the vectors whose elements never move: segment
+// k holds cvector_segment_capacity(k) elements, twice as many as segment
+// k - 1, so that adding a segment never touches the existing ones and an
+// index maps to its segment through a leading zero count.
+#define CVEC_FIRST_SEGMENT_SHIFT 4
+#define CVEC_MAX_SEGMENTS (64 - CVEC_FIRST_SEGMENT_SHIFT)
+// Number of elements all the segments add up to.
+#define CVEC_MAX_SEGMENTED_COUNT \
+  (UINT64_MAX - ((1u << CVEC_FIRST_SEGMENT_SHIFT) - 1))
+
+static inline uint64_t cvector_segment_capacity(uint32_t segment) {
+  return (uint64_t)1 << (segment + CVEC_FIRST_SEGMENT_SHIFT);
+}
+
+// Index of the first element of the segment.
+static inline uint64_t cvector_segment_start(uint32_t segment) {
+  return cvector_segment_capacity(segment) -
+         cvector_segment_capacity(0);
+}
+
+// Returns the segment holding the element at 'index', which must be below
+// CVEC_MAX_SEGMENTED_COUNT, along with its offset in there.
+static inline uint32_t cvector_segment_of(uint64_t index, uint64_t* offset) {
+  uint64_t biased = index + cvector_segment_capacity(0);
+  uint32_t msb = 63 - (uint32_t)__builtin_clzll(biased);
+  *offset = biased - ((uint64_t)1 << msb);
+  return msb - CVEC_FIRST_SEGMENT_SHIFT;
+}
+
+// Eases off the core while spinning on a value another thread updates.
+#if defined(__x86_64__) || defined(__i386__)
+#define cvector_cpu_relax() __builtin_ia32_pause()
+#elif defined(__aarch64__)
+#define cvector_cpu_relax() __asm__ __volatile__("yield")
+#else
+#define cvector_cpu_relax() ((void)0)
+#endif
@@ -0,0 +1,321 @@
+/*
+MIT License
+
+Copyright (c) 2018 Danis Ozdemir
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "cvector_internal.h"
+
+#include <stdatomic.h>
+#include <string.h>
+
+// The kernels are written once with GCC vector extensions and instantiated
+// for several vector widths, each compiled for its own instruction set
+// through the target attribute. The widest variant the CPU supports is
+// picked at runtime. A vector of a single lane gives the scalar fallback.
+
+#if defined(__x86_64__)
+#define CVEC_X86_KERNELS 1
+#define SSE2_ATTR __attribute__((target("sse2")))
+#define AVX2_ATTR __attribute__((target("avx2")))
+#define AVX512_ATTR __attribute__((target("avx512f")))
+#endif
+
+// Loads a vector and widens it to the accumulator type. Kept as a macro,
+// returning wide vectors by value would change the ABI of the helper.
+#define LOAD_WIDE(isa, sfx, p) \
+  __builtin_convertvector(load_##sfx##_##isa(p), sfx##_##isa##_va)
+
+#define DEFINE_KERNELS(isa, attr, W, sfx, T, A, I)                        \
+  typedef T sfx##_##isa##_vt __attribute__((vector_size(W)));             \
+  typedef A sfx##_##isa##_va                                              \
+      __attribute__((vector_size(W / sizeof(T) * sizeof(A))));            \
+  typedef I sfx##_##isa##_vi __attribute__((vector_size(W)));             \
+                                                                          \
+  attr static inline sfx##_##isa##_vt load_##sfx##_##isa(const T* p) {    \
+    sfx##_##isa##_vt x;                                                   \
+    memcpy(&x, p, W);                                                     \
+    return x;                                                             \
+  }                                                                       \
+                                                                          \
+  attr static void sum_##sfx##_##isa(const T* p, uint64_t n, A* result) { \
+    const uint64_t lanes = W / sizeof(T);                                 \
+    sfx##_##isa##_va acc0 = {0}, acc1 = {0}, acc2 = {0}, acc3 = {0};      \
+    uint64_t i = 0;                                                       \
+    for (; i + 4 * lanes <= n; i += 4 * lanes) {                          \
+      acc0 += LOAD_WIDE(isa, sfx, p + i);                                 \
+      acc1 += LOAD_WIDE(isa, sfx, p + i + lanes);                         \
+      acc2 += LOAD_WIDE(isa, sfx, p + i + 2 * lanes);                     \
+      acc3 += LOAD_WIDE(isa, sfx, p + i + 3 * lanes);                     \
+    }                                                                     \
+    for (; i + lanes <= n; i += lanes) {                                  \
+      acc0 += LOAD_WIDE(isa, sfx, p + i);                                 \
+    }                                                                     \
+    acc0 += acc1 + acc2 + acc3;                                           \
+    A sum = 0;                                                            \
+    for (uint64_t j = 0; j < lanes; ++j) {                                \
+      sum += acc0[j];                                                     \
+    }                                                                     \
+    for (; i < n; ++i) {                                                  \
+      sum += p[i];                                                        \
+    }                                                                     \
+    *result = sum;                                                        \
+  }                                                                       \
+                                                                          \
+  attr static void minmax_##sfx##_##isa(const T* p, uint64_t n, T* min,   \
+                                        T* max) {                         \
+    const uint64_t lanes = W / sizeof(T);                                 \
+    T mn = p[0], mx = p[0];                                               \
+    uint64_t i = 0;                                                       \
+    if (n >= lanes) {                                                     \
+      sfx##_##isa##_vt vmn = load_##sfx##_##isa(p);                       \
+      sfx##_##isa##_vt vmx = vmn;                                         \
+      for (i = lanes; i + lanes <= n; i += lanes) {                       \
+        sfx##_##isa##_vt x = load_##sfx##_##isa(p + i);                   \
+        sfx##_##isa##_vi lt = (sfx##_##isa##_vi)(x < vmn);                \
+        sfx##_##isa##_vi gt = (sfx##_##isa##_vi)(x > vmx);                \
+        vmn = (sfx##_##isa##_vt)(((sfx##_##isa##_vi)x & lt) |             \
+                                 ((sfx##_##isa##_vi)vmn & ~lt));          \
+        vmx = (sfx##_##isa##_vt)(((sfx##_##isa##_vi)x & gt) |             \
+                                 ((sfx##_##isa##_vi)vmx & ~gt));          \
+      }                                                                   \
+      for (uint64_t j = 0; j < lanes; ++j) {                              \
+        mn = vmn[j] < mn ? vmn[j] : mn;                                   \
+        mx = vmx[j] > mx ? vmx[j] : mx;                                   \
+      }                                                                   \
+    }                                                                     \
+    for (; i < n; ++i) {                                                  \
+      mn = p[i] < mn ? p[i] : mn;                                         \
+      mx = p[i] > mx ? p[i] : mx;                                         \
+    }                                                                     \
+    *min = mn;                                                            \
+    *max = mx;                                                            \
+  }                                                                       \
+                                                                          \
+  attr static void fill_##sfx##_##isa(T* p, uint64_t n, T value) {        \
+    const uint64_t lanes = W / sizeof(T);                                 \
+    sfx##_##isa##_vt x = (sfx##_##isa##_vt){0} + value;                   \
+    uint64_t i = 0;                                                       \
+    for (; i + lanes <= n; i += lanes) {                                  \
+      memcpy(p + i, &x, W);                                               \
+    }                                                                     \
+    for (; i < n; ++i) {                                                  \
+      p[i] = value;                                                       \
+    }                                                                     \
+  }                                                                       \
+                                                                          \
+  attr static void scale_##sfx##_##isa(T* p, uint64_t n, T factor) {      \
+    const uint64_t lanes = W / sizeof(T);                                 \
+    sfx##_##isa##_vt f = (sfx##_##isa##_vt){0} + factor;                  \
+    uint64_t i = 0;                                                       \
+    for (; i + lanes <= n; i += lanes) {                                  \
+      sfx##_##isa##_vt x = load_##sfx##_##isa(p + i) * f;                 \
+      memcpy(p + i, &x, W);                                               \
+    }                                                                     \
+    for (; i < n; ++i) {                                                  \
+      p[i] *= factor;                                                     \
+    }                                                                     \
+  }                                                                       \
+                                                                          \
+  attr static void dot_##sfx##_##isa(const T* a, const T* b, uint64_t n,  \
+                                     A* result) {                         \
+    const uint64_t lanes = W / sizeof(T);                                 \
+    sfx##_##isa##_va acc0 = {0}, acc1 = {0};                              \
+    uint64_t i = 0;                                                       \
+    for (; i + 2 * lanes <= n; i += 2 * lanes) {                          \
+      acc0 += LOAD_WIDE(isa, sfx, a + i) * LOAD_WIDE(isa, sfx, b + i);    \
+      acc1 += LOAD_WIDE(isa, sfx, a + i + lanes) *                        \
+              LOAD_WIDE(isa, sfx, b + i + lanes);                         \
+    }                                                                     \
+    acc0 += acc1;                                                         \
+    A sum = 0;                                                            \
+    for (uint64_t j = 0; j < lanes; ++j) {                                \
+      sum += acc0[j];                                                     \
+    }                                                                     \
+    for (; i < n; ++i) {                                                  \
+      sum += (A)a[i] * (A)b[i];                                           \
+    }                                                                     \
+    *result = sum;                                                        \
+  }
+
+#define DEFINE_ISA_KERNELS(isa, attr, W_i32, W_i64)                \
+  DEFINE_KERNELS(isa, attr, W_i32, i32, int32_t, int64_t, int32_t) \
+  DEFINE_KERNELS(isa, attr, W_i64, i64, int64_t, int64_t, int64_t) \
+  DEFINE_KERNELS(isa, attr, W_i32, f32, float, float, int32_t)     \
+  DEFINE_KERNELS(isa, attr, W_i64, f64, double, double, int64_t)   \
+                                                                   \
+  static const kernel_table isa##_kernels = {KERNEL_TABLE_ENTRIES(isa)};
+
+#define KERNEL_TABLE_FIELDS(sfx, T, A)                          \
+  void (*sum_##sfx)(const T* p, uint64_t n, A* result);         \
+  void (*minmax_##sfx)(const T* p, uint64_t n, T* min, T* max); \
+  void (*fill_##sfx)(T * p, uint64_t n, T value);               \
+  void (*scale_##sfx)(T * p, uint64_t n, T factor);             \
+  void (*dot_##sfx)(const T* a, const T* b, uint64_t n, A* result);
+
+#define KERNEL_TABLE_SFX_ENTRIES(isa, sfx)                              \
+  .sum_##sfx = sum_##sfx##_##isa, .minmax_##sfx = minmax_##sfx##_##isa, \
+  .fill_##sfx = fill_##sfx##_##isa, .scale_##sfx = scale_##sfx##_##isa, \
+  .dot_##sfx = dot_##sfx##_##isa
+
+#define KERNEL_TABLE_ENTRIES(isa)                                         \
+  KERNEL_TABLE_SFX_ENTRIES(isa, i32), KERNEL_TABLE_SFX_ENTRIES(isa, i64), \
+      KERNEL_TABLE_SFX_ENTRIES(isa, f32), KERNEL_TABLE_SFX_ENTRIES(isa, f64)
+
+typedef struct kernel_table {
+  KERNEL_TABLE_FIELDS(i32, int32_t, int64_t)
+  KERNEL_TABLE_FIELDS(i64, int64_t, int64_t)
+  KERNEL_TABLE_FIELDS(f32, float, float)
+  KERNEL_TABLE_FIELDS(f64, double, double)
+} kernel_table;
+
+DEFINE_ISA_KERNELS(scalar, , sizeof(int32_t), sizeof(int64_t))
+
+#ifdef CVEC_X86_KERNELS
+DEFINE_ISA_KERNELS(sse2, SSE2_ATTR, 16, 16)
+DEFINE_ISA_KERNELS(avx2, AVX2_ATTR, 32, 32)
+DEFINE_ISA_KERNELS(avx512, AVX512_ATTR, 64, 64)
+#endif
+
+static const kernel_table* const kernel_tables[] = {
+    [cvec_simd_scalar] = &scalar_kernels,
+#ifdef CVEC_X86_KERNELS
+    [cvec_simd_sse2] = &sse2_kernels,
+    [cvec_simd_avx2] = &avx2_kernels,
+    [cvec_simd_avx512] = &avx512_kernels,
+#endif
+};
+
+// -1 until the first kernel call detects what the CPU supports.
+static atomic_int selected_level = -1;
+
+static bool simd_level_supported(cvector_simd_level_t level) {
+  switch (level) {
+    case cvec_simd_scalar:
+      return true;
+#ifdef CVEC_X86_KERNELS
+    case cvec_simd_sse2:
+      return __builtin_cpu_supports("sse2");
+    case cvec_simd_avx2:
+      return __builtin_cpu_supports("avx2");
+    case cvec_simd_avx512:
+      return __builtin_cpu_supports("avx512f");
+#endif
+    default:
+      return false;
+  }
+}
+
+cvector_simd_level_t cvector_simd_level(void) {
+  int level = atomic_load_explicit(&selected_level, memory_order_relaxed);
+  if (level < 0) {
+    __builtin_cpu_init();
+    level = cvec_simd_avx512;
+    while (!simd_level_supported((cvector_simd_level_t)level)) {
+      --level;
+    }
+    atomic_store_explicit(&selected_level, level, memory_order_relaxed);
+  }
+
+  return (cvector_simd_level_t)level;
+}
+
+cvector_retval_t cvector_set_simd_level(cvector_simd_level_t level) {
+  if ((int)level < cvec_simd_scalar || level > cvec_simd_avx512) {
+    return cvec_invalid_arguments;
+  }
+
+  __builtin_cpu_init();
+  if (!simd_level_supported(level)) {
+    return cvec_invalid_arguments;
+  }
+
+  atomic_store_explicit(&selected_level, (int)level, memory_order_relaxed);
+  return cvec_success;
+}
+
+static inline const kernel_table* kernels(void) {
+  return kernel_tables[cvector_simd_level()];
+}
+
+#define DEFINE_PUBLIC_KERNELS(sfx, T, A)                                     \
+  cvector_retval_t cvector_sum_##sfx(cvector* v, A* result) {                \
+    if (!v || !result || v->elem_size != sizeof(T)) {                        \
+      return cvec_invalid_arguments;                                         \
+    }                                                                        \
+    cvector_make_contiguous(v);                                              \
+    kernels()->sum_##sfx((const T*)v->data_ptr, v->elem_count, result);      \
+    return cvec_success;                                                     \
+  }                                                                          \
+                                                                             \
+  cvector_retval_t cvector_minmax_##sfx(cvector* v, T* min, T* max) {        \
+    if (!v || (!min && !max) || v->elem_size != sizeof(T)) {                 \
+      return cvec_invalid_arguments;                                         \
+    }                                                                        \
+    if (v->elem_count == 0) {                                                \
+      return cvec_empty;                                                     \
+    }                                                                        \
+    cvector_make_contiguous(v);                                              \
+    T mn, mx;                                                                \
+    kernels()->minmax_##sfx((const T*)v->data_ptr, v->elem_count, &mn, &mx); \
+    if (min) {                                                               \
+      *min = mn;                                                             \
+    }                                                                        \
+    if (max) {                                                               \
+      *max = mx;                                                             \
+    }                                                                        \
+    return cvec_success;                                                     \
+  }                                                                          \
+                                                                             \
+  cvector_retval_t cvector_fill_##sfx(cvector* v, T value) {                 \
+    if (!v || v->elem_size != sizeof(T)) {                                   \
+      return cvec_invalid_arguments;                                         \
+    }                                                                        \
+    cvector_make_contiguous(v);                                              \
+    kernels()->fill_##sfx((T*)v->data_ptr, v->elem_count, value);            \
+    return cvec_success;                                                     \
+  }                                                                          \
+                                                                             \
+  cvector_retval_t cvector_scale_##sfx(cvector* v, T factor) {               \
+    if (!v || v->elem_size != sizeof(T)) {                                   \
+      return cvec_invalid_arguments;                                         \
+    }                                                                        \
+    cvector_make_contiguous(v);                                              \
+    kernels()->scale_##sfx((T*)v->data_ptr, v->elem_count, factor);          \
+    return cvec_success;                                                     \
+  }                                                                          \
+                                                                             \
+  cvector_retval_t cvector_dot_##sfx(cvector* a, cvector* b, A* result) {    \
+    if (!a || !b || !result || a->elem_size != sizeof(T) ||                  \
+        b->elem_size != sizeof(T) || a->elem_count != b->elem_count) {       \
+      return cvec_invalid_arguments;                                         \
+    }                                                                        \
+    cvector_make_contiguous(a);                                              \
+    cvector_make_contiguous(b);                                              \
+    kernels()->dot_##sfx((const T*)a->data_ptr, (const T*)b->data_ptr,       \
+                         a->elem_count, result);                             \
+    return cvec_success;                                                     \
+  }
+
+DEFINE_PUBLIC_KERNELS(i32, int32_t, int64_t)
+DEFINE_PUBLIC_KERNELS(i64, int64_t, int64_t)
+DEFINE_PUBLIC_KERNELS(f32, float, float)
+DEFINE_PUBLIC_KERNELS(f64, double, double)
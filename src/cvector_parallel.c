@@ -0,0 +1,280 @@
+/*
+MIT License
+
+Copyright (c) 2018 Danis Ozdemir
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "cvector_internal.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+
+// Default number of chunks handed to each thread when the caller does not
+// provide a grain size, so that uneven callbacks still balance out.
+#define chunks_per_thread 4
+
+typedef struct parallel_job {
+  unsigned long data_ptr;
+  uint64_t elem_size;
+  uint64_t elem_count;
+  // Chunk 0 is [0, first_end), chunk k > 0 is
+  // [first_end + (k - 1) * grain, first_end + k * grain).
+  uint64_t first_end;
+  uint64_t grain;
+  uint64_t chunk_count;
+  atomic_uint_fast64_t next_chunk;
+  void (*rw_callback)(uint64_t index, void* elem, void* args);
+  void* args;
+} parallel_job;
+
+struct cvector_thread_pool {
+  // Serializes the jobs submitted by different threads.
+  pthread_mutex_t submit_lock;
+  pthread_mutex_t lock;
+  pthread_cond_t work_available;
+  pthread_cond_t work_done;
+  parallel_job* job;
+  uint64_t generation;
+  uint32_t busy_workers;
+  bool shutting_down;
+  uint32_t worker_count;
+  pthread_t workers[];
+};
+
+static void run_chunks(parallel_job* job) {
+  uint64_t chunk;
+  while ((chunk = atomic_fetch_add_explicit(&job->next_chunk, 1,
+                                            memory_order_relaxed)) <
+         job->chunk_count) {
+    uint64_t begin = chunk ? job->first_end + (chunk - 1) * job->grain : 0;
+    uint64_t end = chunk ? begin + job->grain : job->first_end;
+    if (end > job->elem_count) {
+      end = job->elem_count;
+    }
+
+    for (uint64_t i = begin; i < end; ++i) {
+      job->rw_callback(i, (void*)(job->data_ptr + i * job->elem_size),
+                       job->args);
+    }
+  }
+}
+
+static void* worker_main(void* arg) {
+  cvector_thread_pool* pool = (cvector_thread_pool*)arg;
+  uint64_t seen_generation = 0;
+
+  pthread_mutex_lock(&pool->lock);
+  for (;;) {
+    while (!pool->shutting_down && pool->generation == seen_generation) {
+      pthread_cond_wait(&pool->work_available, &pool->lock);
+    }
+    if (pool->shutting_down) {
+      break;
+    }
+
+    seen_generation = pool->generation;
+    parallel_job* job = pool->job;
+    pthread_mutex_unlock(&pool->lock);
+
+    run_chunks(job);
+
+    pthread_mutex_lock(&pool->lock);
+    if (--pool->busy_workers == 0) {
+      pthread_cond_signal(&pool->work_done);
+    }
+  }
+  pthread_mutex_unlock(&pool->lock);
+
+  return NULL;
+}
+
+static void stop_workers(cvector_thread_pool* pool, uint32_t started) {
+  pthread_mutex_lock(&pool->lock);
+  pool->shutting_down = true;
+  pthread_cond_broadcast(&pool->work_available);
+  pthread_mutex_unlock(&pool->lock);
+
+  for (uint32_t i = 0; i < started; ++i) {
+    pthread_join(pool->workers[i], NULL);
+  }
+
+  pthread_cond_destroy(&pool->work_done);
+  pthread_cond_destroy(&pool->work_available);
+  pthread_mutex_destroy(&pool->lock);
+  pthread_mutex_destroy(&pool->submit_lock);
+}
+
+cvector_thread_pool* cvector_thread_pool_create(uint32_t thread_count,
+                                                char** err) {
+  if (thread_count == 0) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    thread_count = cpus > 0 ? (uint32_t)cpus : 1;
+  }
+
+  // The thread calling cvector_exec_for_each_parallel takes part in the
+  // work as well, hence one worker less.
+  uint32_t worker_count = thread_count - 1;
+  cvector_thread_pool* pool =
+      mem_calloc(1, sizeof(cvector_thread_pool) +
+                        (size_t)worker_count * sizeof(pthread_t));
+  if (!pool) {
+    if (err) {
+      *err = CERR_STR("failed to allocate the thread pool");
+    }
+    return NULL;
+  }
+
+  pthread_mutex_init(&pool->submit_lock, NULL);
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->work_available, NULL);
+  pthread_cond_init(&pool->work_done, NULL);
+
+  for (uint32_t i = 0; i < worker_count; ++i) {
+    if (pthread_create(&pool->workers[i], NULL, worker_main, pool) != 0) {
+      stop_workers(pool, i);
+      mem_free(pool);
+      if (err) {
+        *err = CERR_STR("failed to start the worker threads");
+      }
+      return NULL;
+    }
+  }
+  pool->worker_count = worker_count;
+
+  if (err) {
+    *err = NULL;
+  }
+
+  return pool;
+}
+
+void __cvector_thread_pool_destroy(cvector_thread_pool* pool) {
+  if (pool) {
+    stop_workers(pool, pool->worker_count);
+    mem_free(pool);
+  }
+}
+
+uint32_t cvector_thread_pool_size(cvector_thread_pool* pool) {
+  if (!pool) {
+    return 1;
+  }
+
+  return pool->worker_count + 1;
+}
+
+static uint64_t gcd(uint64_t a, uint64_t b) {
+  while (b) {
+    uint64_t t = a % b;
+    a = b;
+    b = t;
+  }
+  return a;
+}
+
+// Splits the vector into chunks whose boundaries fall on cache line
+// boundaries whenever the element size allows it, so that no two threads
+// write to the same cache line.
+static void plan_chunks(parallel_job* job, uint32_t thread_count,
+                        uint64_t grain_size) {
+  uint64_t line_elems =
+      CVEC_CACHE_LINE_SIZE / gcd(job->elem_size, CVEC_CACHE_LINE_SIZE);
+
+  // The first index starting on a cache line, if there is one.
+  uint64_t first_aligned = 0;
+  for (uint64_t i = 0; i < line_elems; ++i) {
+    if ((job->data_ptr + i * job->elem_size) % CVEC_CACHE_LINE_SIZE == 0) {
+      first_aligned = i;
+      break;
+    }
+  }
+
+  if (!grain_size) {
+    grain_size = job->elem_count / ((uint64_t)thread_count * chunks_per_thread);
+  }
+  // Larger grains give a single chunk anyway, and could overflow below.
+  if (grain_size > job->elem_count) {
+    grain_size = job->elem_count;
+  }
+  if (grain_size < line_elems) {
+    grain_size = line_elems;
+  }
+  job->grain = (grain_size + line_elems - 1) / line_elems * line_elems;
+
+  job->first_end = first_aligned + job->grain;
+  if (job->first_end >= job->elem_count) {
+    job->first_end = job->elem_count;
+    job->chunk_count = 1;
+  } else {
+    job->chunk_count =
+        1 + (job->elem_count - job->first_end + job->grain - 1) / job->grain;
+  }
+  atomic_init(&job->next_chunk, 0);
+}
+
+cvector_retval_t cvector_exec_for_each_parallel(
+    cvector* v,
+    void (*rw_callback)(uint64_t index, void* elem, void* args), void* args,
+    cvector_thread_pool* pool, uint64_t grain_size) {
+  if (!v || !rw_callback) {
+    return cvec_invalid_arguments;
+  }
+
+  if (v->elem_count == 0) {
+    return cvec_success;
+  }
+
+  cvector_make_contiguous(v);
+  parallel_job job = {.data_ptr = (unsigned long)v->data_ptr,
+                      .elem_size = v->elem_size,
+                      .elem_count = v->elem_count,
+                      .rw_callback = rw_callback,
+                      .args = args};
+  plan_chunks(&job, cvector_thread_pool_size(pool), grain_size);
+
+  if (!pool || pool->worker_count == 0 || job.chunk_count == 1) {
+    run_chunks(&job);
+    return cvec_success;
+  }
+
+  pthread_mutex_lock(&pool->submit_lock);
+
+  pthread_mutex_lock(&pool->lock);
+  pool->job = &job;
+  pool->busy_workers = pool->worker_count;
+  ++pool->generation;
+  pthread_cond_broadcast(&pool->work_available);
+  pthread_mutex_unlock(&pool->lock);
+
+  run_chunks(&job);
+
+  pthread_mutex_lock(&pool->lock);
+  while (pool->busy_workers > 0) {
+    pthread_cond_wait(&pool->work_done, &pool->lock);
+  }
+  pool->job = NULL;
+  pthread_mutex_unlock(&pool->lock);
+
+  pthread_mutex_unlock(&pool->submit_lock);
+
+  return cvec_success;
+}
@@ -0,0 +1,481 @@
+/*
+MIT License
+
+Copyright (c) 2018 Danis Ozdemir
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "cvector_internal.h"
+
+#include <stdatomic.h>
+
+// Both queues keep the fields their producers write and those their
+// consumers write on separate cache lines, away from the read only ones.
+struct cvector_spsc_queue {
+  uint32_t elem_size;
+  uint64_t mask;
+  char* data;
+  cvector_memmgmt_procs_t* m_procs;
+  cvector_memmgmt_procs_t procs;
+  // Written by the producer, which also keeps the last head it read to
+  // only look at the consumer's cache line when the ring seems full.
+  _Alignas(CVEC_CACHE_LINE_SIZE) atomic_uint_fast64_t tail;
+  uint64_t cached_head;
+  // Written by the consumer, likewise keeping the last tail it read.
+  _Alignas(CVEC_CACHE_LINE_SIZE) atomic_uint_fast64_t head;
+  uint64_t cached_tail;
+};
+
+// Every slot carries a sequence number telling whose turn it is: it equals
+// the position of the slot while the slot waits for the producer of that
+// position, that position plus one once the element is written, and the
+// position of the next lap once the element is read.
+struct cvector_mpmc_queue {
+  uint32_t elem_size;
+  uint64_t mask;
+  char* data;
+  atomic_uint_fast64_t* sequences;
+  cvector_memmgmt_procs_t* m_procs;
+  cvector_memmgmt_procs_t procs;
+  _Alignas(CVEC_CACHE_LINE_SIZE) atomic_uint_fast64_t tail;
+  _Alignas(CVEC_CACHE_LINE_SIZE) atomic_uint_fast64_t head;
+};
+
+// Validates the arguments and rounds the capacity up to a power of two,
+// at least two as the multi producer queue needs that many slots.
+static bool queue_capacity(uint32_t elem_size, uint64_t* capacity,
+                           cvector_memmgmt_procs_t* mmgt_procs, char** err) {
+  if (elem_size == 0) {
+    if (err) {
+      *err = CERR_STR("elem_size is zero");
+    }
+    return false;
+  }
+
+  if (*capacity == 0 || *capacity > (UINT64_C(1) << 62)) {
+    if (err) {
+      *err = CERR_STR("capacity is zero or too large");
+    }
+    return false;
+  }
+
+  if (!cvector_mm_procs_valid(mmgt_procs)) {
+    if (err) {
+      *err = CERR_STR("Detected at least one NULL memory management function");
+    }
+    return false;
+  }
+
+  *capacity = *capacity < 2 ? 2 : *capacity;
+  *capacity = UINT64_C(1) << (64 - __builtin_clzll(*capacity - 1));
+  return true;
+}
+
+// Returns zero when the ring would not fit in memory.
+static size_t ring_bytes(uint64_t capacity, size_t slot_size) {
+  size_t bytes;
+  if (__builtin_mul_overflow(capacity, slot_size, &bytes) ||
+      bytes > PTRDIFF_MAX) {
+    return 0;
+  }
+  return bytes;
+}
+
+// Allocates the zeroed, cache line aligned header of a queue from the
+// procs.
+static void* alloc_queue(size_t size, cvector_memmgmt_procs_t* mmgt_procs,
+                         char** err) {
+  void* q = cvector_aligned_alloc(mmgt_procs, size);
+  if (!q) {
+    if (err) {
+      *err = CERR_STR("failed to allocate vector container");
+    }
+    return NULL;
+  }
+
+  memset(q, 0, size);
+  return q;
+}
+
+// Copies 'count' elements into the ring starting at position 'pos', in at
+// most two pieces as they may wrap around its end.
+static void copy_into_ring(char* data, uint64_t mask, uint32_t elem_size,
+                           uint64_t pos, const char* src, uint64_t count) {
+  uint64_t slot = pos & mask;
+  uint64_t first_part = mask + 1 - slot;
+  if (first_part > count) {
+    first_part = count;
+  }
+  memcpy(data + slot * elem_size, src, first_part * elem_size);
+  memcpy(data, src + first_part * elem_size,
+         (count - first_part) * elem_size);
+}
+
+static void copy_from_ring(const char* data, uint64_t mask,
+                           uint32_t elem_size, uint64_t pos, char* dest,
+                           uint64_t count) {
+  uint64_t slot = pos & mask;
+  uint64_t first_part = mask + 1 - slot;
+  if (first_part > count) {
+    first_part = count;
+  }
+  memcpy(dest, data + slot * elem_size, first_part * elem_size);
+  memcpy(dest + first_part * elem_size, data,
+         (count - first_part) * elem_size);
+}
+
+cvector_spsc_queue* cvector_spsc_queue_create(
+    uint32_t elem_size, uint64_t capacity,
+    cvector_memmgmt_procs_t* mmgt_procs, char** err) {
+  if (!queue_capacity(elem_size, &capacity, mmgt_procs, err)) {
+    return NULL;
+  }
+
+  cvector_spsc_queue* q =
+      alloc_queue(sizeof(cvector_spsc_queue), mmgt_procs, err);
+  if (!q) {
+    return NULL;
+  }
+
+  q->elem_size = elem_size;
+  q->mask = capacity - 1;
+  if (mmgt_procs) {
+    q->procs = *mmgt_procs;
+    q->m_procs = &q->procs;
+  }
+  size_t bytes = ring_bytes(capacity, elem_size);
+  q->data = bytes ? _mem_alloc(q->m_procs, bytes) : NULL;
+  if (!q->data) {
+    cvector_aligned_free(mmgt_procs, q, sizeof(cvector_spsc_queue));
+    if (err) {
+      *err = CERR_STR("failed to allocate vector container");
+    }
+    return NULL;
+  }
+  atomic_init(&q->tail, 0);
+  atomic_init(&q->head, 0);
+
+  if (err) {
+    *err = NULL;
+  }
+
+  return q;
+}
+
+void __cvector_spsc_queue_destroy(cvector_spsc_queue* q) {
+  if (!q) {
+    return;
+  }
+
+  _mem_free(q->m_procs, q->data, ring_bytes(q->mask + 1, q->elem_size));
+  // The procs live in the header, copy them before freeing it.
+  cvector_memmgmt_procs_t procs = q->procs;
+  cvector_aligned_free(q->m_procs ? &procs : NULL, q,
+                       sizeof(cvector_spsc_queue));
+}
+
+cvector_retval_t cvector_spsc_queue_enqueue_n(cvector_spsc_queue* q,
+                                              const void* elems,
+                                              uint64_t count,
+                                              uint64_t* enqueued) {
+  if (enqueued) {
+    *enqueued = 0;
+  }
+
+  if (!q || !elems) {
+    return cvec_invalid_arguments;
+  }
+
+  if (count == 0) {
+    return cvec_success;
+  }
+
+  uint64_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+  uint64_t room = q->mask + 1 - (tail - q->cached_head);
+  if (room < count) {
+    q->cached_head = atomic_load_explicit(&q->head, memory_order_acquire);
+    room = q->mask + 1 - (tail - q->cached_head);
+    if (room == 0) {
+      return cvec_full;
+    }
+  }
+
+  uint64_t n = room < count ? room : count;
+  copy_into_ring(q->data, q->mask, q->elem_size, tail, elems, n);
+  atomic_store_explicit(&q->tail, tail + n, memory_order_release);
+
+  if (enqueued) {
+    *enqueued = n;
+  }
+
+  return cvec_success;
+}
+
+cvector_retval_t cvector_spsc_queue_enqueue(cvector_spsc_queue* q,
+                                            const void* elem) {
+  return cvector_spsc_queue_enqueue_n(q, elem, 1, NULL);
+}
+
+cvector_retval_t cvector_spsc_queue_dequeue_n(cvector_spsc_queue* q,
+                                              void* target_elems,
+                                              uint64_t count,
+                                              uint64_t* dequeued) {
+  if (dequeued) {
+    *dequeued = 0;
+  }
+
+  if (!q || !target_elems) {
+    return cvec_invalid_arguments;
+  }
+
+  if (count == 0) {
+    return cvec_success;
+  }
+
+  uint64_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+  uint64_t available = q->cached_tail - head;
+  if (available < count) {
+    q->cached_tail = atomic_load_explicit(&q->tail, memory_order_acquire);
+    available = q->cached_tail - head;
+    if (available == 0) {
+      return cvec_empty;
+    }
+  }
+
+  uint64_t n = available < count ? available : count;
+  copy_from_ring(q->data, q->mask, q->elem_size, head, target_elems, n);
+  atomic_store_explicit(&q->head, head + n, memory_order_release);
+
+  if (dequeued) {
+    *dequeued = n;
+  }
+
+  return cvec_success;
+}
+
+cvector_retval_t cvector_spsc_queue_dequeue(cvector_spsc_queue* q,
+                                            void* target_elem) {
+  return cvector_spsc_queue_dequeue_n(q, target_elem, 1, NULL);
+}
+
+uint64_t cvector_spsc_queue_elem_count(cvector_spsc_queue* q) {
+  if (!q) {
+    return 0;
+  }
+
+  uint64_t head = atomic_load_explicit(&q->head, memory_order_acquire);
+  uint64_t tail = atomic_load_explicit(&q->tail, memory_order_acquire);
+  return tail > head ? tail - head : 0;
+}
+
+uint64_t cvector_spsc_queue_capacity(cvector_spsc_queue* q) {
+  return q ? q->mask + 1 : 0;
+}
+
+cvector_mpmc_queue* cvector_mpmc_queue_create(
+    uint32_t elem_size, uint64_t capacity,
+    cvector_memmgmt_procs_t* mmgt_procs, char** err) {
+  if (!queue_capacity(elem_size, &capacity, mmgt_procs, err)) {
+    return NULL;
+  }
+
+  cvector_mpmc_queue* q =
+      alloc_queue(sizeof(cvector_mpmc_queue), mmgt_procs, err);
+  if (!q) {
+    return NULL;
+  }
+
+  q->elem_size = elem_size;
+  q->mask = capacity - 1;
+  if (mmgt_procs) {
+    q->procs = *mmgt_procs;
+    q->m_procs = &q->procs;
+  }
+  // The sequence numbers come first so they stay aligned.
+  size_t bytes =
+      ring_bytes(capacity, sizeof(atomic_uint_fast64_t) + elem_size);
+  q->sequences = bytes ? _mem_alloc(q->m_procs, bytes) : NULL;
+  if (!q->sequences) {
+    cvector_aligned_free(mmgt_procs, q, sizeof(cvector_mpmc_queue));
+    if (err) {
+      *err = CERR_STR("failed to allocate vector container");
+    }
+    return NULL;
+  }
+  q->data = (char*)(q->sequences + capacity);
+  for (uint64_t i = 0; i < capacity; ++i) {
+    atomic_init(&q->sequences[i], i);
+  }
+  atomic_init(&q->tail, 0);
+  atomic_init(&q->head, 0);
+
+  if (err) {
+    *err = NULL;
+  }
+
+  return q;
+}
+
+void __cvector_mpmc_queue_destroy(cvector_mpmc_queue* q) {
+  if (!q) {
+    return;
+  }
+
+  _mem_free(q->m_procs, q->sequences,
+            ring_bytes(q->mask + 1,
+                       sizeof(atomic_uint_fast64_t) + q->elem_size));
+  cvector_memmgmt_procs_t procs = q->procs;
+  cvector_aligned_free(q->m_procs ? &procs : NULL, q,
+                       sizeof(cvector_mpmc_queue));
+}
+
+// Claims up to 'count' consecutive slots starting at 'index', the tail for
+// producers and the head for consumers, whose sequence numbers say they
+// are ready for them: 'pos + ready' where ready is 0 for producers and 1
+// for consumers. Stores the first claimed position in 'pos' and returns
+// how many slots were claimed, zero when the queue is full or empty. A
+// single compare and swap claims the whole run, the sequence numbers
+// cannot change under it as only the owner of a position updates its slot.
+static uint64_t claim_slots(cvector_mpmc_queue* q, atomic_uint_fast64_t* index,
+                            uint64_t ready, uint64_t count, uint64_t* pos) {
+  uint64_t first = atomic_load_explicit(index, memory_order_relaxed);
+  for (;;) {
+    uint64_t sequence = atomic_load_explicit(
+        &q->sequences[first & q->mask], memory_order_acquire);
+    int64_t lag = (int64_t)(sequence - (first + ready));
+    if (lag < 0) {
+      return 0;
+    }
+
+    if (lag > 0) {
+      first = atomic_load_explicit(index, memory_order_relaxed);
+      continue;
+    }
+
+    uint64_t n = 1;
+    while (n < count &&
+           atomic_load_explicit(&q->sequences[(first + n) & q->mask],
+                                memory_order_acquire) == first + n + ready) {
+      ++n;
+    }
+
+    if (atomic_compare_exchange_weak_explicit(index, &first, first + n,
+                                              memory_order_relaxed,
+                                              memory_order_relaxed)) {
+      *pos = first;
+      return n;
+    }
+    cvector_cpu_relax();
+  }
+}
+
+cvector_retval_t cvector_mpmc_queue_enqueue_n(cvector_mpmc_queue* q,
+                                              const void* elems,
+                                              uint64_t count,
+                                              uint64_t* enqueued) {
+  if (enqueued) {
+    *enqueued = 0;
+  }
+
+  if (!q || !elems) {
+    return cvec_invalid_arguments;
+  }
+
+  if (count == 0) {
+    return cvec_success;
+  }
+
+  uint64_t pos;
+  uint64_t n = claim_slots(q, &q->tail, 0, count, &pos);
+  if (n == 0) {
+    return cvec_full;
+  }
+
+  copy_into_ring(q->data, q->mask, q->elem_size, pos, elems, n);
+  for (uint64_t i = 0; i < n; ++i) {
+    atomic_store_explicit(&q->sequences[(pos + i) & q->mask], pos + i + 1,
+                          memory_order_release);
+  }
+
+  if (enqueued) {
+    *enqueued = n;
+  }
+
+  return cvec_success;
+}
+
+cvector_retval_t cvector_mpmc_queue_enqueue(cvector_mpmc_queue* q,
+                                            const void* elem) {
+  return cvector_mpmc_queue_enqueue_n(q, elem, 1, NULL);
+}
+
+cvector_retval_t cvector_mpmc_queue_dequeue_n(cvector_mpmc_queue* q,
+                                              void* target_elems,
+                                              uint64_t count,
+                                              uint64_t* dequeued) {
+  if (dequeued) {
+    *dequeued = 0;
+  }
+
+  if (!q || !target_elems) {
+    return cvec_invalid_arguments;
+  }
+
+  if (count == 0) {
+    return cvec_success;
+  }
+
+  uint64_t pos;
+  uint64_t n = claim_slots(q, &q->head, 1, count, &pos);
+  if (n == 0) {
+    return cvec_empty;
+  }
+
+  copy_from_ring(q->data, q->mask, q->elem_size, pos, target_elems, n);
+  for (uint64_t i = 0; i < n; ++i) {
+    atomic_store_explicit(&q->sequences[(pos + i) & q->mask],
+                          pos + i + q->mask + 1, memory_order_release);
+  }
+
+  if (dequeued) {
+    *dequeued = n;
+  }
+
+  return cvec_success;
+}
+
+cvector_retval_t cvector_mpmc_queue_dequeue(cvector_mpmc_queue* q,
+                                            void* target_elem) {
+  return cvector_mpmc_queue_dequeue_n(q, target_elem, 1, NULL);
+}
+
+uint64_t cvector_mpmc_queue_elem_count(cvector_mpmc_queue* q) {
+  if (!q) {
+    return 0;
+  }
+
+  uint64_t head = atomic_load_explicit(&q->head, memory_order_acquire);
+  uint64_t tail = atomic_load_explicit(&q->tail, memory_order_acquire);
+  return tail > head ? tail - head : 0;
+}
+
+uint64_t cvector_mpmc_queue_capacity(cvector_mpmc_queue* q) {
+  return q ? q->mask + 1 : 0;
+}
@@ -0,0 +1,236 @@
+/*
+MIT License
+
+Copyright (c) 2018 Danis Ozdemir
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "cvector_internal.h"
+
+// Ranges spanning fewer bytes than this are assumed to be in the cache
+// already, so their probes are not prefetched.
+#define prefetch_span (16 * CVEC_CACHE_LINE_SIZE)
+
+typedef int (*cvector_key_cmp_t)(const void* key, const void* elem);
+
+// Both searches below keep the answer in [base, base + n] and halve n on
+// every step without branching on the comparison, which the compiler turns
+// into a conditional move. The four candidate probes of the step after the
+// next are prefetched while the current one is being compared, hiding most
+// of the cache misses of large vectors. This is a macro as GCC deems a
+// function doing nothing but prefetching free of side effects and drops its
+// calls before inlining them.
+#define prefetch_next_probes(base, n, half, es)                            \
+  do {                                                                     \
+    if ((n) * (es) >= prefetch_span) {                                     \
+      uint64_t quarter = (half) / 4;                                       \
+      __builtin_prefetch((base) + quarter * (es));                         \
+      __builtin_prefetch((base) + ((half) / 2 + quarter) * (es));          \
+      __builtin_prefetch((base) + ((half) + quarter) * (es));              \
+      __builtin_prefetch((base) + ((half) + (half) / 2 + quarter) * (es)); \
+    }                                                                      \
+  } while (0)
+
+// Returns the index of the first element for which 'goes_before' is false,
+// with goes_before(elem) being cmp(key, elem) > 0, or >= 0 when searching
+// for the upper bound.
+static uint64_t bound_by_cmp(const char* data, uint64_t n, size_t es,
+                             const void* key, cvector_key_cmp_t cmp,
+                             bool upper) {
+  if (n == 0) {
+    return 0;
+  }
+  const char* base = data;
+  while (n > 1) {
+    uint64_t half = n / 2;
+    prefetch_next_probes(base, n, half, es);
+    int c = cmp(key, base + half * es);
+    base = (upper ? c >= 0 : c > 0) ? base + half * es : base;
+    n -= half;
+  }
+  int c = cmp(key, base);
+  return (uint64_t)(base - data) / es + (upper ? c >= 0 : c > 0);
+}
+
+// Instantiates the search on keys of a given size so that the switch
+// reading them does not run in the loop.
+#define DEFINE_BOUND_BY_KEY(KS)                                              \
+  static uint64_t bound_by_key_##KS(const char* data, uint64_t n, size_t es, \
+                                    uint64_t key, bool upper) {              \
+    if (n == 0) {                                                            \
+      return 0;                                                              \
+    }                                                                        \
+    const char* base = data;                                                 \
+    while (n > 1) {                                                          \
+      uint64_t half = n / 2;                                                 \
+      prefetch_next_probes(base, n, half, es);                               \
+      uint64_t k = cvector_read_key(base + half * es, KS);                   \
+      base = (upper ? k <= key : k < key) ? base + half * es : base;         \
+      n -= half;                                                             \
+    }                                                                        \
+    uint64_t k = cvector_read_key(base, KS);                                 \
+    return (uint64_t)(base - data) / es + (upper ? k <= key : k < key);      \
+  }
+
+DEFINE_BOUND_BY_KEY(1)
+DEFINE_BOUND_BY_KEY(2)
+DEFINE_BOUND_BY_KEY(4)
+DEFINE_BOUND_BY_KEY(8)
+
+static inline uint64_t bound_by_key(const char* data, uint64_t n, size_t es,
+                                    uint32_t key_size, uint64_t key,
+                                    bool upper) {
+  switch (key_size) {
+    case 1:
+      return bound_by_key_1(data, n, es, key, upper);
+    case 2:
+      return bound_by_key_2(data, n, es, key, upper);
+    case 4:
+      return bound_by_key_4(data, n, es, key, upper);
+    default:
+      return bound_by_key_8(data, n, es, key, upper);
+  }
+}
+
+cvector_retval_t cvector_lower_bound(cvector* v, const void* key,
+                                     int (*cmp)(const void* key,
+                                                const void* elem),
+                                     uint64_t* index) {
+  if (!v || !cmp || !index) {
+    return cvec_invalid_arguments;
+  }
+  cvector_make_contiguous(v);
+  *index = bound_by_cmp(v->data_ptr, v->elem_count, v->elem_size, key, cmp,
+                        false);
+  return cvec_success;
+}
+
+cvector_retval_t cvector_upper_bound(cvector* v, const void* key,
+                                     int (*cmp)(const void* key,
+                                                const void* elem),
+                                     uint64_t* index) {
+  if (!v || !cmp || !index) {
+    return cvec_invalid_arguments;
+  }
+  cvector_make_contiguous(v);
+  *index = bound_by_cmp(v->data_ptr, v->elem_count, v->elem_size, key, cmp,
+                        true);
+  return cvec_success;
+}
+
+cvector_retval_t cvector_equal_range(cvector* v, const void* key,
+                                     int (*cmp)(const void* key,
+                                                const void* elem),
+                                     uint64_t* first, uint64_t* last) {
+  if (!v || !cmp || !first || !last) {
+    return cvec_invalid_arguments;
+  }
+  cvector_make_contiguous(v);
+  size_t es = v->elem_size;
+  uint64_t lower =
+      bound_by_cmp(v->data_ptr, v->elem_count, es, key, cmp, false);
+  // The upper bound cannot be before the lower one.
+  uint64_t upper =
+      lower + bound_by_cmp((char*)v->data_ptr + lower * es,
+                           v->elem_count - lower, es, key, cmp, true);
+  *first = lower;
+  *last = upper;
+  return lower == upper ? cvec_key_not_found : cvec_success;
+}
+
+cvector_retval_t cvector_lower_bound_by_key(cvector* v, uint32_t key_offset,
+                                            uint32_t key_size, uint64_t key,
+                                            uint64_t* index) {
+  if (!v || !index || !cvector_valid_key(v, key_offset, key_size)) {
+    return cvec_invalid_arguments;
+  }
+  cvector_make_contiguous(v);
+  *index = bound_by_key((char*)v->data_ptr + key_offset, v->elem_count,
+                        v->elem_size, key_size, key, false);
+  return cvec_success;
+}
+
+cvector_retval_t cvector_upper_bound_by_key(cvector* v, uint32_t key_offset,
+                                            uint32_t key_size, uint64_t key,
+                                            uint64_t* index) {
+  if (!v || !index || !cvector_valid_key(v, key_offset, key_size)) {
+    return cvec_invalid_arguments;
+  }
+  cvector_make_contiguous(v);
+  *index = bound_by_key((char*)v->data_ptr + key_offset, v->elem_count,
+                        v->elem_size, key_size, key, true);
+  return cvec_success;
+}
+
+cvector_retval_t cvector_equal_range_by_key(cvector* v, uint32_t key_offset,
+                                            uint32_t key_size, uint64_t key,
+                                            uint64_t* first, uint64_t* last) {
+  if (!v || !first || !last || !cvector_valid_key(v, key_offset, key_size)) {
+    return cvec_invalid_arguments;
+  }
+  cvector_make_contiguous(v);
+  size_t es = v->elem_size;
+  const char* keys = (char*)v->data_ptr + key_offset;
+  uint64_t lower =
+      bound_by_key(keys, v->elem_count, es, key_size, key, false);
+  uint64_t upper =
+      lower + bound_by_key(keys + lower * es, v->elem_count - lower, es,
+                           key_size, key, true);
+  *first = lower;
+  *last = upper;
+  return lower == upper ? cvec_key_not_found : cvec_success;
+}
+
+cvector_retval_t cvector_lower_bound_batch_by_key(
+    cvector* v, uint32_t key_offset, uint32_t key_size, const uint64_t* keys,
+    uint64_t key_count, uint64_t* indexes) {
+  if (!v || (key_count && (!keys || !indexes)) ||
+      !cvector_valid_key(v, key_offset, key_size)) {
+    return cvec_invalid_arguments;
+  }
+
+  cvector_make_contiguous(v);
+  size_t es = v->elem_size;
+  uint64_t n = v->elem_count;
+  const char* elem_keys = (char*)v->data_ptr + key_offset;
+  uint64_t lo = 0;
+  for (uint64_t q = 0; q < key_count; ++q) {
+    uint64_t key = keys[q];
+    // Unsorted queries are still answered, just without the head start.
+    if (q > 0 && key < keys[q - 1]) {
+      lo = 0;
+    }
+    // Gallops forward from the previous answer so that a batch of m
+    // queries costs O(m log(n / m)) comparisons rather than O(m log n).
+    uint64_t hi = lo;
+    uint64_t step = 1;
+    while (hi < n && cvector_read_key(elem_keys + hi * es, key_size) < key) {
+      lo = hi + 1;
+      hi += step;
+      step *= 2;
+    }
+    if (hi > n) {
+      hi = n;
+    }
+    lo += bound_by_key(elem_keys + lo * es, hi - lo, es, key_size, key, false);
+    indexes[q] = lo;
+  }
+  return cvec_success;
+}
@@ -0,0 +1,282 @@
+/*
+MIT License
+
+Copyright (c) 2018 Danis Ozdemir
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "cvector_internal.h"
+
+struct cvector_segmented {
+  uint32_t elem_size;
+  uint64_t elem_count;
+  // Segments [0, segment_count) are allocated.
+  uint32_t segment_count;
+  cvector_memmgmt_procs_t* m_procs;
+  cvector_memmgmt_procs_t procs;
+  char* segments[CVEC_MAX_SEGMENTS];
+};
+
+cvector_segmented* cvector_segmented_create(
+    uint32_t elem_size, cvector_memmgmt_procs_t* mmgt_procs, char** err) {
+  if (elem_size == 0) {
+    if (err) {
+      *err = CERR_STR("elem_size is zero");
+    }
+    return NULL;
+  }
+
+  if (!cvector_mm_procs_valid(mmgt_procs)) {
+    if (err) {
+      *err = CERR_STR("Detected at least one NULL memory management function");
+    }
+    return NULL;
+  }
+
+  cvector_segmented* v = _mem_alloc(mmgt_procs, sizeof(cvector_segmented));
+  if (!v) {
+    if (err) {
+      *err = CERR_STR("failed to allocate vector container");
+    }
+    return NULL;
+  }
+
+  memset(v, 0, sizeof(*v));
+  v->elem_size = elem_size;
+  if (mmgt_procs) {
+    v->procs = *mmgt_procs;
+    v->m_procs = &v->procs;
+  }
+
+  if (err) {
+    *err = NULL;
+  }
+
+  return v;
+}
+
+// Computes the byte size of the segment, zero if it can not be allocated.
+static size_t segment_bytes(const cvector_segmented* v, uint32_t segment) {
+  size_t bytes;
+  if (__builtin_mul_overflow(cvector_segment_capacity(segment),
+                             (uint64_t)v->elem_size, &bytes) ||
+      bytes > PTRDIFF_MAX) {
+    return 0;
+  }
+  return bytes;
+}
+
+static void free_segments_from(cvector_segmented* v, uint32_t first) {
+  while (v->segment_count > first) {
+    --v->segment_count;
+    _mem_free(v->m_procs, v->segments[v->segment_count],
+              segment_bytes(v, v->segment_count));
+    v->segments[v->segment_count] = NULL;
+  }
+}
+
+void __cvector_segmented_destroy(cvector_segmented* v) {
+  if (v) {
+    free_segments_from(v, 0);
+    // The procs live in the header, copy them before freeing it.
+    cvector_memmgmt_procs_t procs = v->procs;
+    _mem_free(v->m_procs ? &procs : NULL, v, sizeof(cvector_segmented));
+  }
+}
+
+static inline uint64_t capacity_of(uint32_t segment_count) {
+  return segment_count ? cvector_segment_start(segment_count - 1) +
+                             cvector_segment_capacity(segment_count - 1)
+                       : 0;
+}
+
+// Adds segments until 'capacity' elements fit, leaving the existing ones
+// where they are.
+static bool make_room_for(cvector_segmented* v, uint64_t capacity) {
+  if (capacity > CVEC_MAX_SEGMENTED_COUNT) {
+    return false;
+  }
+
+  while (capacity_of(v->segment_count) < capacity) {
+    size_t bytes = segment_bytes(v, v->segment_count);
+    char* segment = bytes ? _mem_alloc(v->m_procs, bytes) : NULL;
+    if (!segment) {
+      return false;
+    }
+    v->segments[v->segment_count++] = segment;
+  }
+
+  return true;
+}
+
+static inline char* elem_ptr(const cvector_segmented* v, uint64_t index) {
+  uint64_t offset;
+  uint32_t segment = cvector_segment_of(index, &offset);
+  return v->segments[segment] + offset * v->elem_size;
+}
+
+cvector_retval_t cvector_segmented_push_back(cvector_segmented* v,
+                                             const void* new_elem) {
+  if (!v || !new_elem) {
+    return cvec_invalid_arguments;
+  }
+
+  if (v->elem_count == capacity_of(v->segment_count) &&
+      !make_room_for(v, v->elem_count + 1)) {
+    return cvec_not_enough_memory;
+  }
+
+  memcpy(elem_ptr(v, v->elem_count), new_elem, v->elem_size);
+  ++v->elem_count;
+
+  return cvec_success;
+}
+
+cvector_retval_t cvector_segmented_push_back_n(cvector_segmented* v,
+                                               const void* new_elems,
+                                               uint64_t count) {
+  if (!v || (!new_elems && count > 0)) {
+    return cvec_invalid_arguments;
+  }
+
+  if (count > CVEC_MAX_SEGMENTED_COUNT - v->elem_count ||
+      !make_room_for(v, v->elem_count + count)) {
+    return cvec_not_enough_memory;
+  }
+
+  // One copy per segment the elements land in.
+  const char* src = new_elems;
+  while (count > 0) {
+    uint64_t offset;
+    uint32_t segment = cvector_segment_of(v->elem_count, &offset);
+    uint64_t n = cvector_segment_capacity(segment) - offset;
+    if (n > count) {
+      n = count;
+    }
+    memcpy(v->segments[segment] + offset * v->elem_size, src,
+           n * v->elem_size);
+    src += n * v->elem_size;
+    v->elem_count += n;
+    count -= n;
+  }
+
+  return cvec_success;
+}
+
+cvector_retval_t cvector_segmented_pop_back(cvector_segmented* v,
+                                            void* target_elem) {
+  if (!v || !target_elem) {
+    return cvec_invalid_arguments;
+  }
+
+  if (v->elem_count == 0) {
+    return cvec_empty;
+  }
+
+  --v->elem_count;
+  memcpy(target_elem, elem_ptr(v, v->elem_count), v->elem_size);
+
+  return cvec_success;
+}
+
+cvector_retval_t cvector_segmented_get_ptr_at(cvector_segmented* v,
+                                              uint64_t index,
+                                              void** target_elem_ptr) {
+  if (!v || !target_elem_ptr) {
+    return cvec_invalid_arguments;
+  }
+
+  if (index >= v->elem_count) {
+    return cvec_key_not_found;
+  }
+
+  *target_elem_ptr = elem_ptr(v, index);
+
+  return cvec_success;
+}
+
+cvector_retval_t cvector_segmented_get_copy_at(cvector_segmented* v,
+                                               uint64_t index,
+                                               void* target_elem) {
+  if (!v || !target_elem) {
+    return cvec_invalid_arguments;
+  }
+
+  if (index >= v->elem_count) {
+    return cvec_key_not_found;
+  }
+
+  memcpy(target_elem, elem_ptr(v, index), v->elem_size);
+
+  return cvec_success;
+}
+
+uint64_t cvector_segmented_elem_count(cvector_segmented* v) {
+  return v ? v->elem_count : 0;
+}
+
+uint64_t cvector_segmented_capacity(cvector_segmented* v) {
+  return v ? capacity_of(v->segment_count) : 0;
+}
+
+cvector_retval_t cvector_segmented_reserve(cvector_segmented* v,
+                                           uint64_t capacity) {
+  if (!v) {
+    return cvec_invalid_arguments;
+  }
+
+  return make_room_for(v, capacity) ? cvec_success : cvec_not_enough_memory;
+}
+
+cvector_retval_t cvector_segmented_shrink_to_fit(cvector_segmented* v) {
+  if (!v) {
+    return cvec_invalid_arguments;
+  }
+
+  uint32_t needed = 0;
+  while (capacity_of(needed) < v->elem_count) {
+    ++needed;
+  }
+  free_segments_from(v, needed);
+
+  return cvec_success;
+}
+
+void cvector_segmented_exec_for_each(
+    cvector_segmented* v,
+    void (*read_write_callback)(uint64_t index, void* elem, void* args),
+    void* args) {
+  if (!v || !read_write_callback) {
+    return;
+  }
+
+  uint64_t index = 0;
+  for (uint32_t segment = 0; index < v->elem_count; ++segment) {
+    char* data = v->segments[segment];
+    uint64_t end = capacity_of(segment + 1);
+    if (end > v->elem_count) {
+      end = v->elem_count;
+    }
+    for (; index < end; ++index) {
+      read_write_callback(index, data, args);
+      data += v->elem_size;
+    }
+  }
+}
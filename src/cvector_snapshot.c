@@ -0,0 +1,269 @@
+/*
+MIT License
+
+Copyright (c) 2018 Danis Ozdemir
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "cvector_internal.h"
+
+#include <stdatomic.h>
+
+// Data containers of vectors with snapshot reads. The header lets readers
+// clamp the published count to what the container they got can hold, and
+// chains the containers the writer retired.
+typedef struct snapshot_buffer {
+  struct snapshot_buffer* next;
+  uint64_t capacity;
+  size_t bytes;
+  // The epoch the buffer was retired in.
+  uint64_t retired_in;
+  _Alignas(max_align_t) char data[];
+} snapshot_buffer;
+
+// A reader slot holds the epoch its reader started in, zero when free.
+typedef struct reader_slot {
+  _Alignas(CVEC_CACHE_LINE_SIZE) atomic_uint_fast64_t epoch;
+} reader_slot;
+
+struct cvector_readers {
+  _Atomic(snapshot_buffer*) current;
+  atomic_uint_fast64_t elem_count;
+  // Starts at one so that free slots can be told apart.
+  _Alignas(CVEC_CACHE_LINE_SIZE) atomic_uint_fast64_t epoch;
+  reader_slot slots[CVEC_SNAPSHOT_READERS];
+  // Written by the writer only, oldest first.
+  snapshot_buffer* retired;
+  snapshot_buffer* last_retired;
+};
+
+static inline snapshot_buffer* buffer_of(void* data) {
+  return (snapshot_buffer*)((char*)data - offsetof(snapshot_buffer, data));
+}
+
+static snapshot_buffer* new_buffer(cvector* v, uint64_t capacity,
+                                   size_t bytes) {
+  if (bytes > PTRDIFF_MAX - sizeof(snapshot_buffer)) {
+    return NULL;
+  }
+
+  snapshot_buffer* buffer =
+      _mem_alloc(cvector_procs(v), sizeof(snapshot_buffer) + bytes);
+  if (buffer) {
+    buffer->next = NULL;
+    buffer->capacity = capacity;
+    buffer->bytes = sizeof(snapshot_buffer) + bytes;
+  }
+  return buffer;
+}
+
+bool create_the_cvector_readers(cvector* v, uint64_t capacity, size_t bytes) {
+  cvector_readers* r =
+      cvector_aligned_alloc(cvector_procs(v), sizeof(cvector_readers));
+  if (!r) {
+    return false;
+  }
+
+  snapshot_buffer* buffer = new_buffer(v, capacity, bytes);
+  if (!buffer) {
+    cvector_aligned_free(cvector_procs(v), r, sizeof(cvector_readers));
+    return false;
+  }
+
+  atomic_init(&r->current, buffer);
+  atomic_init(&r->elem_count, 0);
+  atomic_init(&r->epoch, 1);
+  for (uint32_t i = 0; i < CVEC_SNAPSHOT_READERS; ++i) {
+    atomic_init(&r->slots[i].epoch, 0);
+  }
+  r->retired = NULL;
+  r->last_retired = NULL;
+
+  v->readers = r;
+  v->data_ptr = buffer->data;
+  v->capacity = capacity;
+
+  return true;
+}
+
+// Frees the retired buffers older than every running snapshot. A reader
+// publishes its epoch before loading the current buffer, so one that
+// started after a buffer was retired can only have loaded a newer one.
+static void reclaim_retired_buffers(cvector* v) {
+  cvector_readers* r = v->readers;
+  if (!r->retired) {
+    return;
+  }
+
+  uint64_t oldest = UINT64_MAX;
+  for (uint32_t i = 0; i < CVEC_SNAPSHOT_READERS; ++i) {
+    uint64_t epoch = atomic_load(&r->slots[i].epoch);
+    if (epoch && epoch < oldest) {
+      oldest = epoch;
+    }
+  }
+
+  while (r->retired && r->retired->retired_in < oldest) {
+    snapshot_buffer* buffer = r->retired;
+    r->retired = buffer->next;
+    _mem_free(cvector_procs(v), buffer, buffer->bytes);
+  }
+  if (!r->retired) {
+    r->last_retired = NULL;
+  }
+}
+
+bool set_the_snapshot_capacity(cvector* v, uint64_t new_capacity,
+                               size_t bytes) {
+  cvector_readers* r = v->readers;
+  snapshot_buffer* buffer = new_buffer(v, new_capacity, bytes);
+  if (!buffer) {
+    return false;
+  }
+
+  // Readers may still go by the last published count, which is larger
+  // than the current one when shrinking after a removal. The elements past
+  // the current count are still intact in the old buffer, so they move
+  // along.
+  uint64_t count = atomic_load_explicit(&r->elem_count, memory_order_relaxed);
+  if (count < v->elem_count) {
+    count = v->elem_count;
+  }
+  if (count > new_capacity) {
+    count = new_capacity;
+  }
+  memcpy(buffer->data, v->data_ptr, count * v->elem_size);
+
+  // Readers that started before the epoch moves on may still be using the
+  // old buffer.
+  snapshot_buffer* old = buffer_of(v->data_ptr);
+  atomic_store(&r->current, buffer);
+  old->retired_in = atomic_fetch_add(&r->epoch, 1);
+  if (r->last_retired) {
+    r->last_retired->next = old;
+  } else {
+    r->retired = old;
+  }
+  r->last_retired = old;
+
+  v->data_ptr = buffer->data;
+  v->capacity = new_capacity;
+
+  reclaim_retired_buffers(v);
+
+  return true;
+}
+
+void destroy_the_cvector_readers(cvector* v) {
+  cvector_readers* r = v->readers;
+  snapshot_buffer* buffer = buffer_of(v->data_ptr);
+  _mem_free(cvector_procs(v), buffer, buffer->bytes);
+  while (r->retired) {
+    buffer = r->retired;
+    r->retired = buffer->next;
+    _mem_free(cvector_procs(v), buffer, buffer->bytes);
+  }
+  cvector_aligned_free(cvector_procs(v), r, sizeof(cvector_readers));
+  v->readers = NULL;
+}
+
+void publish_the_snapshot_count(cvector* v) {
+  atomic_store_explicit(&v->readers->elem_count, v->elem_count,
+                        memory_order_release);
+}
+
+cvector_retval_t cvector_snapshot_begin(cvector* v,
+                                        cvector_snapshot* snapshot) {
+  if (!v || !v->readers || !snapshot) {
+    return cvec_invalid_arguments;
+  }
+
+  cvector_readers* r = v->readers;
+  uint64_t epoch = atomic_load(&r->epoch);
+  uint32_t slot = 0;
+  for (;; ++slot) {
+    if (slot == CVEC_SNAPSHOT_READERS) {
+      return cvec_not_enough_memory;
+    }
+    uint_fast64_t expected = 0;
+    if (atomic_compare_exchange_strong(&r->slots[slot].epoch, &expected,
+                                       epoch)) {
+      break;
+    }
+  }
+
+  // The count first: every buffer current from then on holds the elements
+  // it covers, up to its capacity should the vector have shrunk since.
+  uint64_t count = atomic_load_explicit(&r->elem_count, memory_order_acquire);
+  snapshot_buffer* buffer = atomic_load(&r->current);
+  snapshot->data = buffer->data;
+  snapshot->elem_count = count < buffer->capacity ? count : buffer->capacity;
+  snapshot->elem_size = v->elem_size;
+  snapshot->slot = slot;
+
+  return cvec_success;
+}
+
+void cvector_snapshot_end(cvector* v, cvector_snapshot* snapshot) {
+  if (!v || !v->readers || !snapshot ||
+      snapshot->slot >= CVEC_SNAPSHOT_READERS) {
+    return;
+  }
+
+  atomic_store_explicit(&v->readers->slots[snapshot->slot].epoch, 0,
+                        memory_order_release);
+  snapshot->data = NULL;
+  snapshot->elem_count = 0;
+  snapshot->slot = CVEC_SNAPSHOT_READERS;
+}
+
+cvector_retval_t cvector_snapshot_exec_for_each(
+    cvector* v, void (*read_callback)(uint64_t index, const void* elem,
+                                      void* args),
+    void* args) {
+  if (!read_callback) {
+    return cvec_invalid_arguments;
+  }
+
+  cvector_snapshot snapshot;
+  cvector_retval_t result = cvector_snapshot_begin(v, &snapshot);
+  if (result != cvec_success) {
+    return result;
+  }
+
+  const char* elem = snapshot.data;
+  for (uint64_t i = 0; i < snapshot.elem_count; ++i) {
+    read_callback(i, elem, args);
+    elem += snapshot.elem_size;
+  }
+  cvector_snapshot_end(v, &snapshot);
+
+  return cvec_success;
+}
+
+cvector_retval_t cvector_snapshot_reclaim(cvector* v) {
+  if (!v || !v->readers) {
+    return cvec_invalid_arguments;
+  }
+
+  reclaim_retired_buffers(v);
+
+  return cvec_success;
+}
@@ -0,0 +1,264 @@
+/*
+MIT License
+
+Copyright (c) 2018 Danis Ozdemir
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "cvector_internal.h"
+
+#include <string.h>
+
+// Partitions smaller than this are finished off with insertion sort.
+#define insertion_sort_threshold 16
+
+typedef int (*cvector_cmp_t)(const void* a, const void* b);
+
+static inline void swap_elems(char* a, char* b, size_t elem_size) {
+  char tmp[64];
+  while (elem_size > 0) {
+    size_t n = elem_size < sizeof(tmp) ? elem_size : sizeof(tmp);
+    memcpy(tmp, a, n);
+    memcpy(a, b, n);
+    memcpy(b, tmp, n);
+    a += n;
+    b += n;
+    elem_size -= n;
+  }
+}
+
+// Instantiates an introsort for a given element size. When ES is a
+// constant, the compiler turns every swap into a few register moves
+// instead of going through byte-wise copies.
+#define DEFINE_INTROSORT(sfx, ES)                                              \
+  static void insertion_sort_##sfx(char* base, size_t n, size_t es,            \
+                                   cvector_cmp_t cmp) {                        \
+    (void)es;                                                                  \
+    for (size_t i = 1; i < n; ++i) {                                           \
+      for (char* p = base + i * ES; p > base && cmp(p - ES, p) > 0; p -= ES) { \
+        swap_elems(p - ES, p, ES);                                             \
+      }                                                                        \
+    }                                                                          \
+  }                                                                            \
+                                                                               \
+  static void sift_down_##sfx(char* base, size_t root, size_t n, size_t es,    \
+                              cvector_cmp_t cmp) {                             \
+    (void)es;                                                                  \
+    for (;;) {                                                                 \
+      size_t child = 2 * root + 1;                                             \
+      if (child >= n) {                                                        \
+        return;                                                                \
+      }                                                                        \
+      char* c = base + child * ES;                                             \
+      if (child + 1 < n && cmp(c, c + ES) < 0) {                               \
+        ++child;                                                               \
+        c += ES;                                                               \
+      }                                                                        \
+      if (cmp(base + root * ES, c) >= 0) {                                     \
+        return;                                                                \
+      }                                                                        \
+      swap_elems(base + root * ES, c, ES);                                     \
+      root = child;                                                            \
+    }                                                                          \
+  }                                                                            \
+                                                                               \
+  static void heap_sort_##sfx(char* base, size_t n, size_t es,                 \
+                              cvector_cmp_t cmp) {                             \
+    for (size_t i = n / 2; i-- > 0;) {                                         \
+      sift_down_##sfx(base, i, n, es, cmp);                                    \
+    }                                                                          \
+    for (size_t end = n - 1; end > 0; --end) {                                 \
+      swap_elems(base, base + end * ES, ES);                                   \
+      sift_down_##sfx(base, 0, end, es, cmp);                                  \
+    }                                                                          \
+  }                                                                            \
+                                                                               \
+  static void introsort_##sfx(char* base, size_t n, size_t es,                 \
+                              cvector_cmp_t cmp, uint32_t depth_limit) {       \
+    (void)es;                                                                  \
+    while (n > insertion_sort_threshold) {                                     \
+      if (depth_limit-- == 0) {                                                \
+        heap_sort_##sfx(base, n, es, cmp);                                     \
+        return;                                                                \
+      }                                                                        \
+                                                                               \
+      /* Median of three, which also leaves sentinels at both ends. */         \
+      char* first = base;                                                      \
+      char* mid = base + (n / 2) * ES;                                         \
+      char* last = base + (n - 1) * ES;                                        \
+      if (cmp(mid, first) < 0) {                                               \
+        swap_elems(mid, first, ES);                                            \
+      }                                                                        \
+      if (cmp(last, mid) < 0) {                                                \
+        swap_elems(last, mid, ES);                                             \
+        if (cmp(mid, first) < 0) {                                             \
+          swap_elems(mid, first, ES);                                          \
+        }                                                                      \
+      }                                                                        \
+      swap_elems(first, mid, ES);                                              \
+                                                                               \
+      size_t i = 0;                                                            \
+      size_t j = n;                                                            \
+      for (;;) {                                                               \
+        do {                                                                   \
+          ++i;                                                                 \
+        } while (cmp(base + i * ES, base) < 0);                                \
+        do {                                                                   \
+          --j;                                                                 \
+        } while (cmp(base + j * ES, base) > 0);                                \
+        if (i >= j) {                                                          \
+          break;                                                               \
+        }                                                                      \
+        swap_elems(base + i * ES, base + j * ES, ES);                          \
+      }                                                                        \
+      swap_elems(base, base + j * ES, ES);                                     \
+                                                                               \
+      /* Recurse into the smaller side to bound the stack depth. */            \
+      size_t left = j;                                                         \
+      size_t right = n - j - 1;                                                \
+      if (left < right) {                                                      \
+        introsort_##sfx(base, left, es, cmp, depth_limit);                     \
+        base += (j + 1) * ES;                                                  \
+        n = right;                                                             \
+      } else {                                                                 \
+        introsort_##sfx(base + (j + 1) * ES, right, es, cmp, depth_limit);     \
+        n = left;                                                              \
+      }                                                                        \
+    }                                                                          \
+    insertion_sort_##sfx(base, n, es, cmp);                                    \
+  }
+
+DEFINE_INTROSORT(1, 1)
+DEFINE_INTROSORT(2, 2)
+DEFINE_INTROSORT(4, 4)
+DEFINE_INTROSORT(8, 8)
+DEFINE_INTROSORT(16, 16)
+DEFINE_INTROSORT(generic, es)
+
+cvector_retval_t cvector_sort(cvector* v,
+                              int (*cmp)(const void* a, const void* b)) {
+  if (!v || !cmp) {
+    return cvec_invalid_arguments;
+  }
+
+  size_t n = v->elem_count;
+  if (n < 2) {
+    return cvec_success;
+  }
+
+  cvector_make_contiguous(v);
+  uint32_t depth_limit = 2 * (63 - __builtin_clzll(n));
+  char* base = (char*)v->data_ptr;
+
+  switch (v->elem_size) {
+    case 1:
+      introsort_1(base, n, 1, cmp, depth_limit);
+      break;
+    case 2:
+      introsort_2(base, n, 2, cmp, depth_limit);
+      break;
+    case 4:
+      introsort_4(base, n, 4, cmp, depth_limit);
+      break;
+    case 8:
+      introsort_8(base, n, 8, cmp, depth_limit);
+      break;
+    case 16:
+      introsort_16(base, n, 16, cmp, depth_limit);
+      break;
+    default:
+      introsort_generic(base, n, v->elem_size, cmp, depth_limit);
+      break;
+  }
+
+  return cvec_success;
+}
+
+cvector_retval_t cvector_sort_by_key(cvector* v, uint32_t key_offset,
+                                     uint32_t key_size) {
+  if (!v || !cvector_valid_key(v, key_offset, key_size)) {
+    return cvec_invalid_arguments;
+  }
+
+  uint64_t n = v->elem_count;
+  if (n < 2) {
+    return cvec_success;
+  }
+
+  cvector_make_contiguous(v);
+  // One histogram per key byte, all built in a single pass.
+  uint64_t counts[sizeof(uint64_t)][256];
+  memset(counts, 0, key_size * sizeof(counts[0]));
+
+  size_t es = v->elem_size;
+  char* src = (char*)v->data_ptr;
+  for (uint64_t i = 0; i < n; ++i) {
+    uint64_t key = cvector_read_key(src + i * es + key_offset, key_size);
+    for (uint32_t b = 0; b < key_size; ++b) {
+      ++counts[b][(key >> (8 * b)) & 0xff];
+    }
+  }
+
+  char* scratch = NULL;
+  char* dst = NULL;
+  uint64_t first_key = cvector_read_key(src + key_offset, key_size);
+  for (uint32_t b = 0; b < key_size; ++b) {
+    // A byte that is the same for every key does not reorder anything.
+    if (counts[b][(first_key >> (8 * b)) & 0xff] == n) {
+      continue;
+    }
+
+    if (!scratch) {
+      scratch = _mem_alloc(cvector_procs(v), n * es);
+      if (!scratch) {
+        return cvec_not_enough_memory;
+      }
+      dst = scratch;
+    }
+
+    uint64_t offsets[256];
+    uint64_t sum = 0;
+    for (int d = 0; d < 256; ++d) {
+      offsets[d] = sum;
+      sum += counts[b][d];
+    }
+
+    for (uint64_t i = 0; i < n; ++i) {
+      const char* elem = src + i * es;
+      uint8_t digit =
+          (cvector_read_key(elem + key_offset, key_size) >> (8 * b)) & 0xff;
+      memcpy(dst + offsets[digit]++ * es, elem, es);
+    }
+
+    char* tmp = src;
+    src = dst;
+    dst = tmp;
+  }
+
+  if (src != (char*)v->data_ptr) {
+    memcpy(v->data_ptr, src, n * es);
+  }
+
+  if (scratch) {
+    _mem_free(cvector_procs(v), scratch, n * es);
+  }
+
+  return cvec_success;
+}
@@ -1,7 +1,12 @@
 #include <cvector.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
 #include <stdlib.h>
 #include <string.h>
 #include <tau/tau.h>
+#include <unistd.h>
 TAU_MAIN()  // sets up Tau (+ main function)
 
 // C_VECTOR TESTS
@@ -94,6 +99,64 @@ TEST(cvectors, simple_push_backs_with_memmgmt_procs) {
   cvector_destroy(cvec);
 }
 
+void* failing_realloc(void* ptr, size_t size) {
+  (void)ptr;
+  (void)size;
+  return NULL;
+}
+
+TEST(cvectors, bulk_push_backs) {
+  cvector* cvec = cvector_create(sizeof(int), NULL);
+
+  REQUIRE_EQ(cvector_push_back_n(NULL, &(int){1}, 1), cvec_invalid_arguments);
+  REQUIRE_EQ(cvector_push_back_n(cvec, NULL, 1), cvec_invalid_arguments);
+  REQUIRE_EQ(cvector_push_back_n(cvec, NULL, 0), cvec_success);
+
+  int arr[100];
+  for (int i = 0; i < 100; ++i) {
+    arr[i] = i;
+  }
+
+  REQUIRE_EQ(cvector_push_back(cvec, &(int){-1}), cvec_success);
+  REQUIRE_EQ(cvector_push_back_n(cvec, arr, 100), cvec_success);
+  REQUIRE_EQ(cvector_elem_count(cvec), 101);
+
+  int target = -2;
+  REQUIRE_EQ(cvector_get_copy_at(cvec, 0, &target), cvec_success);
+  REQUIRE_EQ(target, -1);
+  for (int i = 0; i < 100; ++i) {
+    REQUIRE_EQ(cvector_get_copy_at(cvec, i + 1, &target), cvec_success);
+    REQUIRE_EQ(target, i);
+  }
+
+  CVEC_PUSH_ARRAY(cvec, arr);
+  REQUIRE_EQ(cvector_elem_count(cvec), 201);
+
+  cvector_destroy(cvec);
+}
+
+TEST(cvectors, bulk_push_back_fails) {
+  cvector* cvec = cvector_create_mp(
+      sizeof(int),
+      &(cvector_memmgmt_procs_t){.malloc = malloc,
+                                 .free = free,
+                                 .calloc = calloc,
+                                 .realloc = failing_realloc},
+      NULL);
+
+  REQUIRE_EQ(cvector_push_back(cvec, &(int){7}), cvec_success);
+
+  int arr[16] = {0};
+  REQUIRE_EQ(cvector_push_back_n(cvec, arr, 16), cvec_not_enough_memory);
+  REQUIRE_EQ(cvector_elem_count(cvec), 1);
+
+  int target = -2;
+  REQUIRE_EQ(cvector_get_copy_at(cvec, 0, &target), cvec_success);
+  REQUIRE_EQ(target, 7);
+
+  cvector_destroy(cvec);
+}
+
 TEST(cvectors, access_an_index) {
   cvector* cvec = cvector_create(sizeof(int), NULL);
 
@@ -328,6 +391,1877 @@ TEST(cvectors, scaling) {
   cvector_destroy(cvec);
 }
 
+TEST(cvectors, reserve_and_shrink_to_fit) {
+  cvector* cvec = cvector_create(sizeof(int), NULL);
+
+  REQUIRE_EQ(cvector_reserve(NULL, 10), cvec_invalid_arguments);
+  REQUIRE_EQ(cvector_shrink_to_fit(NULL), cvec_invalid_arguments);
+  REQUIRE_EQ(cvector_capacity(NULL), 0);
+
+  REQUIRE_EQ(cvector_reserve(cvec, 1000), cvec_success);
+  uint32_t reserved = cvector_capacity(cvec);
+  REQUIRE_GE(reserved, 1000);
+
+  for (int i = 0; i < 1000; ++i) {
+    REQUIRE_EQ(cvector_push_back(cvec, &i), cvec_success);
+  }
+  REQUIRE_EQ(cvector_capacity(cvec), reserved);
+
+  // Reserving less than what we have must not shrink the vector.
+  REQUIRE_EQ(cvector_reserve(cvec, 10), cvec_success);
+  REQUIRE_EQ(cvector_capacity(cvec), reserved);
+
+  int tmp;
+  for (int i = 0; i < 990; ++i) {
+    cvector_pop_back(cvec, &tmp);
+  }
+  REQUIRE_EQ(cvector_shrink_to_fit(cvec), cvec_success);
+  REQUIRE_EQ(cvector_capacity(cvec), 10);
+
+  for (int i = 0; i < 10; ++i) {
+    REQUIRE_EQ(cvector_get_copy_at(cvec, i, &tmp), cvec_success);
+    REQUIRE_EQ(tmp, i);
+  }
+
+  cvector_reset(cvec);
+  REQUIRE_EQ(cvector_shrink_to_fit(cvec), cvec_success);
+  REQUIRE_EQ(cvector_capacity(cvec), minimum_capacity);
+
+  cvector_destroy(cvec);
+}
+
+uint64_t grow_by_ten(uint64_t capacity, uint64_t required, void* args) {
+  ++*(int*)args;
+  return capacity + 10 > required ? capacity + 10 : required;
+}
+
+TEST(cvectors, growth_policies) {
+  char* err_str = NULL;
+  cvector* cvec = cvector_create_opts(
+      sizeof(int),
+      &(cvector_create_opts_t){.growth_policy = {.kind = cvec_growth_custom}},
+      &err_str);
+  REQUIRE_EQ((void*)cvec, NULL);
+  REQUIRE_NE((void*)err_str, NULL);
+
+  cvec = cvector_create_opts(
+      sizeof(int),
+      &(cvector_create_opts_t){
+          .growth_policy = {.kind = cvec_growth_one_and_half}},
+      &err_str);
+  REQUIRE_NE((void*)cvec, NULL);
+  REQUIRE_EQ((void*)err_str, NULL);
+  for (uint32_t i = 0; i < minimum_capacity; ++i) {
+    cvector_push_back(cvec, &i);
+  }
+  REQUIRE_EQ(cvector_get_capacity(cvec), minimum_capacity * 3 / 2);
+  cvector_destroy(cvec);
+
+  int calls = 0;
+  cvec = cvector_create_opts(
+      sizeof(int),
+      &(cvector_create_opts_t){.growth_policy = {.kind = cvec_growth_custom,
+                                                 .callback = grow_by_ten,
+                                                 .args = &calls}},
+      NULL);
+  for (uint32_t i = 0; i < minimum_capacity; ++i) {
+    cvector_push_back(cvec, &i);
+  }
+  REQUIRE_EQ(calls, 1);
+  REQUIRE_EQ(cvector_get_capacity(cvec), minimum_capacity + 10);
+
+  int arr[100] = {0};
+  REQUIRE_EQ(cvector_push_back_n(cvec, arr, 100), cvec_success);
+  REQUIRE_EQ(calls, 2);
+  REQUIRE_GT(cvector_get_capacity(cvec), minimum_capacity + 100);
+  cvector_destroy(cvec);
+
+  cvector_growth_kind_t kinds[] = {cvec_growth_double, cvec_growth_golden_ratio,
+                                   cvec_growth_page};
+  for (size_t k = 0; k < sizeof(kinds) / sizeof(kinds[0]); ++k) {
+    cvec = cvector_create_opts(
+        sizeof(int),
+        &(cvector_create_opts_t){.growth_policy = {.kind = kinds[k]}}, NULL);
+    for (int i = 0; i < 10000; ++i) {
+      REQUIRE_EQ(cvector_push_back(cvec, &i), cvec_success);
+    }
+    for (int i = 0; i < 10000; ++i) {
+      int target = -1;
+      REQUIRE_EQ(cvector_get_copy_at(cvec, i, &target), cvec_success);
+      REQUIRE_EQ(target, i);
+    }
+    cvector_destroy(cvec);
+  }
+}
+
+TEST(cvectors, shrink_policies) {
+  char* err_str = NULL;
+  cvector* cvec = cvector_create_opts(
+      sizeof(int),
+      &(cvector_create_opts_t){
+          .shrink_policy = {.kind = (cvector_shrink_kind_t)-1}},
+      &err_str);
+  REQUIRE_EQ((void*)cvec, NULL);
+  REQUIRE_NE((void*)err_str, NULL);
+
+  cvec = cvector_create_opts(
+      sizeof(int),
+      &(cvector_create_opts_t){.shrink_policy = {.kind = cvec_shrink_never}},
+      NULL);
+  for (int i = 0; i < 64; ++i) {
+    cvector_push_back(cvec, &i);
+  }
+  uint32_t capacity = cvector_get_capacity(cvec);
+  int tmp;
+  for (int i = 0; i < 64; ++i) {
+    cvector_pop_back(cvec, &tmp);
+  }
+  REQUIRE_EQ(cvector_get_capacity(cvec), capacity);
+  REQUIRE_EQ(cvector_shrink_to_fit(cvec), cvec_success);
+  REQUIRE_EQ(cvector_get_capacity(cvec), minimum_capacity);
+  cvector_destroy(cvec);
+
+  cvec = cvector_create_opts(
+      sizeof(int),
+      &(cvector_create_opts_t){
+          .shrink_policy = {.kind = cvec_shrink_hysteresis, .hold_ops = 3}},
+      NULL);
+  for (int i = 0; i < 64; ++i) {
+    cvector_push_back(cvec, &i);
+  }
+  capacity = cvector_get_capacity(cvec);
+  while (cvector_elem_count(cvec) >= capacity / minimum_capacity) {
+    cvector_pop_back(cvec, &tmp);
+  }
+  // Oscillating around the low water mark must not cause any shrinking.
+  for (int i = 0; i < 10; ++i) {
+    cvector_push_back(cvec, &tmp);
+    cvector_pop_back(cvec, &tmp);
+  }
+  REQUIRE_EQ(cvector_get_capacity(cvec), capacity);
+
+  // Staying below it does, even with pushes in between.
+  cvector_pop_back(cvec, &tmp);
+  cvector_push_back(cvec, &tmp);
+  REQUIRE_EQ(cvector_get_capacity(cvec), capacity);
+  cvector_pop_back(cvec, &tmp);
+  REQUIRE_EQ(cvector_get_capacity(cvec), capacity / scaling_factor);
+  cvector_destroy(cvec);
+
+  // Halving must leave room for the elements whatever the low water mark.
+  REQUIRE(!cvector_create_opts(
+      sizeof(int),
+      &(cvector_create_opts_t){.shrink_policy = {.low_water_divisor = 1}},
+      &err_str));
+  REQUIRE_NE((void*)err_str, NULL);
+  cvec = cvector_create_opts(
+      sizeof(int),
+      &(cvector_create_opts_t){.shrink_policy = {.low_water_divisor = 2}},
+      NULL);
+  REQUIRE(cvec);
+  for (int i = 0; i < 64; ++i) {
+    cvector_push_back(cvec, &i);
+  }
+  while (cvector_elem_count(cvec) > 0) {
+    cvector_pop_back(cvec, &tmp);
+    REQUIRE_GE(cvector_get_capacity(cvec), cvector_elem_count(cvec));
+    for (uint32_t i = 0; i < cvector_elem_count(cvec); ++i) {
+      cvector_get_copy_at(cvec, i, &tmp);
+      REQUIRE_EQ(tmp, (int)i);
+    }
+  }
+  cvector_destroy(cvec);
+}
+
+void add_index_to_sum(uint64_t index, void* elem, void* args) {
+  *(uint64_t*)args += index + *(int*)elem;
+}
+
+TEST(cvectors, api_64) {
+  cvector* cvec = cvector_create(sizeof(int), NULL);
+
+  int arr[10] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9};
+  REQUIRE_EQ(cvector_push_back_n64(cvec, arr, 10), cvec_success);
+  REQUIRE_EQ(cvector_elem_count64(cvec), 10);
+  REQUIRE_EQ(cvector_reserve64(cvec, 100), cvec_success);
+  REQUIRE_GE(cvector_capacity64(cvec), 100);
+
+  int target = -1;
+  int* ptr = NULL;
+  REQUIRE_EQ(cvector_get_copy_at64(cvec, 9, &target), cvec_success);
+  REQUIRE_EQ(target, 9);
+  REQUIRE_EQ(cvector_get_ptr_at64(cvec, 3, (void**)&ptr), cvec_success);
+  REQUIRE_EQ(*ptr, 3);
+  REQUIRE_EQ(cvector_get_copy_at64(cvec, (uint64_t)UINT32_MAX + 1, &target),
+             cvec_key_not_found);
+
+  uint64_t sum = 0;
+  cvector_exec_for_each64(cvec, add_index_to_sum, &sum);
+  REQUIRE_EQ(sum, 90);
+
+  // Sizes that can not be represented must be rejected, not wrapped.
+  REQUIRE_EQ(cvector_reserve64(cvec, UINT64_MAX / 2), cvec_not_enough_memory);
+  REQUIRE_EQ(cvector_push_back_n64(cvec, arr, UINT64_MAX - 5),
+             cvec_not_enough_memory);
+  REQUIRE_EQ(cvector_elem_count64(cvec), 10);
+  cvector_destroy(cvec);
+
+  // 2^61 elements of 8 bytes do not fit in a size_t.
+  cvec = cvector_create(8, NULL);
+  REQUIRE_EQ(cvector_reserve64(cvec, (uint64_t)1 << 61),
+             cvec_not_enough_memory);
+  REQUIRE_EQ(cvector_capacity64(cvec), minimum_capacity);
+  cvector_destroy(cvec);
+}
+
+CVEC_DEFINE(double, dvec);
+
+TEST(cvectors, typed_vectors) {
+  REQUIRE_EQ(dvec_init(NULL), cvec_invalid_arguments);
+  REQUIRE_EQ(dvec_init_mp(
+                 &(dvec){0},
+                 &(cvector_memmgmt_procs_t){.malloc = malloc, .free = free}),
+             cvec_invalid_arguments);
+
+  dvec v;
+  REQUIRE_EQ(dvec_init_mp(&v, &(cvector_memmgmt_procs_t){.malloc = malloc,
+                                                         .free = free,
+                                                         .calloc = calloc,
+                                                         .realloc = realloc}),
+             cvec_success);
+
+  double d = -1;
+  REQUIRE_EQ(dvec_pop(&v, &d), cvec_empty);
+  REQUIRE_EQ(dvec_size(&v), 0);
+
+  for (int i = 0; i < 1000; ++i) {
+    REQUIRE_EQ(dvec_push(&v, i * 0.5), cvec_success);
+  }
+  REQUIRE_EQ(dvec_size(&v), 1000);
+  REQUIRE_GE(dvec_capacity(&v), 1000);
+
+  double sum = 0;
+  for (uint64_t i = 0; i < dvec_size(&v); ++i) {
+    sum += dvec_at(&v, i);
+  }
+  REQUIRE_EQ(sum, 249750.0);  // 0.5 * 999 * 1000 / 2
+
+  *dvec_ptr(&v, 10) = -3;
+  REQUIRE_EQ(dvec_data(&v)[10], -3);
+
+  REQUIRE_EQ(dvec_pop(&v, &d), cvec_success);
+  REQUIRE_EQ(d, 499.5);
+  REQUIRE_EQ(dvec_shrink_to_fit(&v), cvec_success);
+  REQUIRE_EQ(dvec_capacity(&v), 999);
+  REQUIRE_EQ(dvec_reserve(&v, 5000), cvec_success);
+  REQUIRE_EQ(dvec_capacity(&v), 5000);
+  REQUIRE_EQ(dvec_at(&v, 998), 499.0);
+
+  dvec_clear(&v);
+  REQUIRE_EQ(dvec_size(&v), 0);
+
+  dvec_destroy(&v);
+  REQUIRE_EQ((void*)dvec_data(&v), NULL);
+}
+
+typedef struct batch_stats {
+  uint64_t calls;
+  uint64_t next_index;
+  int64_t sum;
+} batch_stats;
+
+void sum_int_batch(uint64_t start_index, void* elems, uint64_t count,
+                   void* args) {
+  batch_stats* stats = (batch_stats*)args;
+  ++stats->calls;
+  if (start_index != stats->next_index) {
+    stats->sum = INT64_MIN;
+    return;
+  }
+  stats->next_index += count;
+
+  const int* ints = (const int*)elems;
+  for (uint64_t i = 0; i < count; ++i) {
+    stats->sum += ints[i];
+  }
+}
+
+TEST(cvectors, exec_for_each_batch) {
+  cvector* cvec = cvector_create(sizeof(int), NULL);
+
+  batch_stats stats = {0};
+  cvector_exec_for_each_batch(cvec, sum_int_batch, &stats, 0);
+  REQUIRE_EQ(stats.calls, 0);
+
+  for (int i = 0; i < 1000; ++i) {
+    cvector_push_back(cvec, &i);
+  }
+
+  cvector_exec_for_each_batch(cvec, sum_int_batch, &stats, 0);
+  REQUIRE_EQ(stats.calls, 1);
+  REQUIRE_EQ(stats.sum, 499500);
+
+  stats = (batch_stats){0};
+  CVEC_FOR_EACH_BATCH(cvec, sum_int_batch, &stats, 64);
+  REQUIRE_EQ(stats.calls, 16);  // 15 full spans and one of 40 elements
+  REQUIRE_EQ(stats.next_index, 1000);
+  REQUIRE_EQ(stats.sum, 499500);
+
+  cvector_destroy(cvec);
+}
+
+typedef struct twelve_bytes {
+  uint32_t visits;
+  uint32_t index;
+  uint32_t pad;
+} twelve_bytes;
+
+void visit_twelve_bytes(uint64_t index, void* elem, void* args) {
+  twelve_bytes* tb = (twelve_bytes*)elem;
+  ++tb->visits;
+  tb->index = (uint32_t)index;
+  if (args) {
+    atomic_fetch_add((atomic_uint_fast64_t*)args, 1);
+  }
+}
+
+typedef struct single_chunk_check {
+  pthread_t thread;
+  uint64_t next_index;
+  bool in_order;
+} single_chunk_check;
+
+// Only race free when a single thread visits every element, in order.
+static void visit_in_order(uint64_t index, void* elem, void* args) {
+  (void)elem;
+  single_chunk_check* check = args;
+  if (index == 0) {
+    check->thread = pthread_self();
+  } else {
+    check->in_order &= pthread_equal(check->thread, pthread_self()) &&
+                       index == check->next_index;
+  }
+  check->next_index = index + 1;
+}
+
+TEST(cvectors, exec_for_each_parallel) {
+  char* err_str = NULL;
+  cvector_thread_pool* pool = cvector_thread_pool_create(4, &err_str);
+  REQUIRE_NE((void*)pool, NULL);
+  REQUIRE_EQ((void*)err_str, NULL);
+  REQUIRE_EQ(cvector_thread_pool_size(pool), 4);
+
+  cvector* cvec = cvector_create(sizeof(twelve_bytes), NULL);
+  REQUIRE_EQ(cvector_exec_for_each_parallel(cvec, NULL, NULL, pool, 0),
+             cvec_invalid_arguments);
+  REQUIRE_EQ(cvector_exec_for_each_parallel(cvec, visit_twelve_bytes, NULL,
+                                            pool, 0),
+             cvec_success);
+
+  twelve_bytes zero = {0};
+  for (int i = 0; i < 100003; ++i) {
+    cvector_push_back(cvec, &zero);
+  }
+
+  uint64_t grains[] = {0, 1, 7, 1000, 1000000};
+  for (size_t g = 0; g < sizeof(grains) / sizeof(grains[0]); ++g) {
+    atomic_uint_fast64_t calls = 0;
+    REQUIRE_EQ(cvector_exec_for_each_parallel(cvec, visit_twelve_bytes, &calls,
+                                              pool, grains[g]),
+               cvec_success);
+    REQUIRE_EQ(atomic_load(&calls), 100003);
+  }
+
+  // A grain covering the whole vector, however large, gives a single chunk.
+  single_chunk_check check = {.in_order = true};
+  REQUIRE_EQ(cvector_exec_for_each_parallel(cvec, visit_in_order, &check,
+                                            pool, UINT64_MAX),
+             cvec_success);
+  REQUIRE(check.in_order);
+  REQUIRE_EQ(check.next_index, 100003);
+
+  REQUIRE_EQ(cvector_exec_for_each_parallel(cvec, visit_twelve_bytes, NULL,
+                                            NULL, 0),
+             cvec_success);
+
+  for (uint32_t i = 0; i < 100003; ++i) {
+    twelve_bytes* tb = NULL;
+    REQUIRE_EQ(cvector_get_ptr_at(cvec, i, (void**)&tb), cvec_success);
+    REQUIRE_EQ(tb->visits, 6);
+    REQUIRE_EQ(tb->index, i);
+  }
+
+  cvector_destroy(cvec);
+  cvector_thread_pool_destroy(pool);
+  REQUIRE_EQ((void*)pool, NULL);
+}
+
+TEST(cvectors, simd_kernels) {
+  cvector* ints = cvector_create(sizeof(int32_t), NULL);
+  cvector* longs = cvector_create(sizeof(int64_t), NULL);
+  cvector* doubles = cvector_create(sizeof(double), NULL);
+  cvector* floats = cvector_create(sizeof(float), NULL);
+
+  int64_t isum = 0;
+  REQUIRE_EQ(cvector_sum_i32(longs, &isum), cvec_invalid_arguments);
+  REQUIRE_EQ(cvector_sum_i32(ints, &isum), cvec_success);
+  REQUIRE_EQ(isum, 0);
+  REQUIRE_EQ(cvector_minmax_i32(ints, NULL, NULL), cvec_invalid_arguments);
+  int32_t imin = 0, imax = 0;
+  REQUIRE_EQ(cvector_minmax_i32(ints, &imin, &imax), cvec_empty);
+
+  // 1003 elements exercise the vector loops as well as the scalar tails.
+  for (int32_t i = 0; i < 1003; ++i) {
+    int32_t iv = (i % 2 ? i : -i) * 1000;
+    int64_t lv = (i % 2 ? i : -i) * 3000000000;
+    double dv = i * 0.25;
+    float fv = (float)(i % 7);
+    cvector_push_back(ints, &iv);
+    cvector_push_back(longs, &lv);
+    cvector_push_back(doubles, &dv);
+    cvector_push_back(floats, &fv);
+  }
+
+  cvector_simd_level_t detected = cvector_simd_level();
+  for (int level = cvec_simd_scalar; level <= cvec_simd_avx512; ++level) {
+    if (cvector_set_simd_level((cvector_simd_level_t)level) != cvec_success) {
+      REQUIRE_GT(level, (int)detected);
+      continue;
+    }
+    REQUIRE_EQ((int)cvector_simd_level(), level);
+
+    REQUIRE_EQ(cvector_sum_i32(ints, &isum), cvec_success);
+    REQUIRE_EQ(isum, -501000);  // 1000 * (1 - 2 + 3 - ... + 1001 - 1002)
+    REQUIRE_EQ(cvector_sum_i64(longs, &isum), cvec_success);
+    REQUIRE_EQ(isum, -1503000000000);
+    double dsum = 0;
+    REQUIRE_EQ(cvector_sum_f64(doubles, &dsum), cvec_success);
+    REQUIRE_EQ(dsum, 125625.75);  // 0.25 * 1002 * 1003 / 2
+    float fsum = 0;
+    REQUIRE_EQ(cvector_sum_f32(floats, &fsum), cvec_success);
+    REQUIRE_EQ(fsum, 3004.0f);  // 143 * 21 + 1
+
+    REQUIRE_EQ(cvector_minmax_i32(ints, &imin, &imax), cvec_success);
+    REQUIRE_EQ(imin, -1002000);
+    REQUIRE_EQ(imax, 1001000);
+    int64_t lmax = 0;
+    REQUIRE_EQ(cvector_minmax_i64(longs, NULL, &lmax), cvec_success);
+    REQUIRE_EQ(lmax, 3003000000000);
+    double dmin = 1, dmax = 0;
+    REQUIRE_EQ(cvector_minmax_f64(doubles, &dmin, &dmax), cvec_success);
+    REQUIRE_EQ(dmin, 0.0);
+    REQUIRE_EQ(dmax, 250.5);
+
+    double ddot = 0;
+    REQUIRE_EQ(cvector_dot_f64(doubles, floats, &ddot),
+               cvec_invalid_arguments);
+    REQUIRE_EQ(cvector_dot_f64(doubles, doubles, &ddot), cvec_success);
+    REQUIRE_EQ(ddot, 20989969.0625);  // 0.0625 * 1002 * 1003 * 2005 / 6
+    REQUIRE_EQ(cvector_dot_i32(ints, ints, &isum), cvec_success);
+    REQUIRE_EQ(isum, 335839505000000);  // 1e6 * 1002 * 1003 * 2005 / 6
+
+    cvector* copy = cvector_create(sizeof(int32_t), NULL);
+    for (int i = 0; i < 1003; ++i) {
+      cvector_push_back(copy, &(int32_t){i});
+    }
+    REQUIRE_EQ(cvector_scale_i32(copy, -3), cvec_success);
+    REQUIRE_EQ(cvector_sum_i32(copy, &isum), cvec_success);
+    REQUIRE_EQ(isum, -1507509);  // -3 * 1002 * 1003 / 2
+    REQUIRE_EQ(cvector_fill_i32(copy, 5), cvec_success);
+    REQUIRE_EQ(cvector_minmax_i32(copy, &imin, &imax), cvec_success);
+    REQUIRE_EQ(imin, 5);
+    REQUIRE_EQ(imax, 5);
+    cvector_destroy(copy);
+  }
+  REQUIRE_EQ(cvector_set_simd_level(detected), cvec_success);
+
+  cvector_destroy(ints);
+  cvector_destroy(longs);
+  cvector_destroy(doubles);
+  cvector_destroy(floats);
+}
+
+int compare_ints(const void* a, const void* b) {
+  int x = *(const int*)a;
+  int y = *(const int*)b;
+  return (x > y) - (x < y);
+}
+
+typedef struct record {
+  uint32_t seq;
+  uint32_t key;
+  char payload[32];
+} record;
+
+int compare_records(const void* a, const void* b) {
+  const record* x = (const record*)a;
+  const record* y = (const record*)b;
+  return (x->key > y->key) - (x->key < y->key);
+}
+
+TEST(cvectors, sort) {
+  cvector* cvec = cvector_create(sizeof(int), NULL);
+  REQUIRE_EQ(cvector_sort(cvec, NULL), cvec_invalid_arguments);
+  REQUIRE_EQ(cvector_sort(cvec, compare_ints), cvec_success);
+
+  srand(42);
+  for (int i = 0; i < 10000; ++i) {
+    cvector_push_back(cvec, &(int){rand() % 1000 - 500});
+  }
+  // A long run of duplicates and a sorted tail.
+  for (int i = 0; i < 1000; ++i) {
+    cvector_push_back(cvec, &(int){7});
+  }
+  for (int i = 0; i < 1000; ++i) {
+    cvector_push_back(cvec, &i);
+  }
+
+  REQUIRE_EQ(cvector_sort(cvec, compare_ints), cvec_success);
+  int prev = INT32_MIN;
+  for (uint32_t i = 0; i < cvector_elem_count(cvec); ++i) {
+    int cur;
+    cvector_get_copy_at(cvec, i, &cur);
+    REQUIRE_LE(prev, cur);
+    prev = cur;
+  }
+  cvector_destroy(cvec);
+
+  cvec = cvector_create(sizeof(record), NULL);
+  for (uint32_t i = 0; i < 5000; ++i) {
+    record r = {.seq = i, .key = (uint32_t)rand() % 300};
+    cvector_push_back(cvec, &r);
+  }
+  REQUIRE_EQ(cvector_sort(cvec, compare_records), cvec_success);
+  for (uint32_t i = 1; i < 5000; ++i) {
+    record *a, *b;
+    cvector_get_ptr_at(cvec, i - 1, (void**)&a);
+    cvector_get_ptr_at(cvec, i, (void**)&b);
+    REQUIRE_LE(a->key, b->key);
+  }
+  cvector_destroy(cvec);
+}
+
+TEST(cvectors, sort_by_key) {
+  cvector* cvec = cvector_create(sizeof(record), NULL);
+  REQUIRE_EQ(cvector_sort_by_key(cvec, 4, 3), cvec_invalid_arguments);
+  REQUIRE_EQ(cvector_sort_by_key(cvec, 36, 8), cvec_invalid_arguments);
+
+  srand(7);
+  for (uint32_t i = 0; i < 20000; ++i) {
+    record r = {.seq = i, .key = (uint32_t)rand() * 7919u};
+    if (i % 3 == 0) {
+      r.key = 12345;
+    }
+    cvector_push_back(cvec, &r);
+  }
+
+  REQUIRE_EQ(cvector_sort_by_key(cvec, offsetof(record, key), 4),
+             cvec_success);
+  for (uint32_t i = 1; i < 20000; ++i) {
+    record *a, *b;
+    cvector_get_ptr_at(cvec, i - 1, (void**)&a);
+    cvector_get_ptr_at(cvec, i, (void**)&b);
+    REQUIRE_LE(a->key, b->key);
+    if (a->key == b->key) {
+      REQUIRE_LT(a->seq, b->seq);  // The radix sort is stable
+    }
+  }
+
+  // Sorting by the sequence number brings the original order back.
+  REQUIRE_EQ(cvector_sort_by_key(cvec, offsetof(record, seq), 4),
+             cvec_success);
+  for (uint32_t i = 0; i < 20000; ++i) {
+    record* r;
+    cvector_get_ptr_at(cvec, i, (void**)&r);
+    REQUIRE_EQ(r->seq, i);
+  }
+
+  cvector_destroy(cvec);
+}
+
+static bool is_multiple_of(const void* elem, void* args) {
+  return *(const int*)elem % *(int*)args == 0;
+}
+
+// Erases every third element it sees, counting its calls.
+static bool every_third_call(const void* elem, void* args) {
+  (void)elem;
+  return ++*(uint64_t*)args % 3 == 0;
+}
+
+TEST(cvectors, insert_and_erase) {
+  cvector* cvec = cvector_create(sizeof(int), NULL);
+  int elems[] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9};
+  REQUIRE_EQ(cvector_insert_at(cvec, 1, &elems[0]), cvec_key_not_found);
+  REQUIRE_EQ(cvector_insert_n_at(cvec, 0, elems + 5, 5), cvec_success);
+  REQUIRE_EQ(cvector_insert_n_at(cvec, 0, elems, 3), cvec_success);
+  REQUIRE_EQ(cvector_insert_at(cvec, 3, &elems[4]), cvec_success);
+  REQUIRE_EQ(cvector_insert_at(cvec, 3, &elems[3]), cvec_success);
+  REQUIRE_EQ(cvector_elem_count64(cvec), 10);
+  for (int i = 0; i < 10; ++i) {
+    int val;
+    cvector_get_copy_at(cvec, i, &val);
+    REQUIRE_EQ(val, i);
+  }
+
+  REQUIRE_EQ(cvector_erase_range(cvec, 4, 3), cvec_invalid_arguments);
+  REQUIRE_EQ(cvector_erase_range(cvec, 8, 11), cvec_key_not_found);
+  REQUIRE_EQ(cvector_erase_range(cvec, 2, 5), cvec_success);
+  int after_erase[] = {0, 1, 5, 6, 7, 8, 9};
+  REQUIRE_EQ(cvector_elem_count64(cvec), 7);
+  for (int i = 0; i < 7; ++i) {
+    int val;
+    cvector_get_copy_at(cvec, i, &val);
+    REQUIRE_EQ(val, after_erase[i]);
+  }
+  cvector_destroy(cvec);
+
+  // Every multiple of 5 goes away, including the first and last elements.
+  cvec = cvector_create(sizeof(int), NULL);
+  for (int i = 0; i < 1000; ++i) {
+    cvector_push_back(cvec, &i);
+  }
+  int divisor = 5;
+  REQUIRE_EQ(cvector_erase_if(cvec, is_multiple_of, &divisor), cvec_success);
+  REQUIRE_EQ(cvector_elem_count64(cvec), 800);
+  int expected = 0;
+  for (int i = 0; i < 800; ++i) {
+    if (++expected % 5 == 0) {
+      ++expected;
+    }
+    int val;
+    cvector_get_copy_at(cvec, i, &val);
+    REQUIRE_EQ(val, expected);
+  }
+
+  // The predicate runs exactly once per element, in order.
+  uint64_t calls = 0;
+  REQUIRE_EQ(cvector_erase_if(cvec, every_third_call, &calls), cvec_success);
+  REQUIRE_EQ(calls, 800);
+  REQUIRE_EQ(cvector_elem_count64(cvec), 534);
+  int first_kept[] = {1, 2, 4, 6, 8, 9};
+  for (int i = 0; i < 6; ++i) {
+    int val;
+    cvector_get_copy_at(cvec, i, &val);
+    REQUIRE_EQ(val, first_kept[i]);
+  }
+
+  // Erasing most of a large vector shrinks it in one go.
+  cvector* large = cvector_create(sizeof(int), NULL);
+  for (int i = 0; i < 1000000; ++i) {
+    cvector_push_back(large, &i);
+  }
+  REQUIRE_EQ(cvector_erase_range(large, 10, 1000000), cvec_success);
+  REQUIRE_EQ(cvector_elem_count64(large), 10);
+  REQUIRE_LE(cvector_capacity64(large), 64);
+  for (int i = 0; i < 10; ++i) {
+    int val;
+    cvector_get_copy_at(large, i, &val);
+    REQUIRE_EQ(val, i);
+  }
+  cvector_destroy(large);
+
+  // Removing everything shrinks the vector all the way down.
+  divisor = 1;
+  REQUIRE_EQ(cvector_erase_if(cvec, is_multiple_of, &divisor), cvec_success);
+  REQUIRE_EQ(cvector_elem_count64(cvec), 0);
+  REQUIRE_EQ(cvector_capacity64(cvec), minimum_capacity);
+
+  cvector_destroy(cvec);
+}
+
+TEST(cvectors, swap_remove) {
+  cvector* cvec = cvector_create(sizeof(int), NULL);
+  REQUIRE_EQ(cvector_swap_remove(cvec, 0, NULL), cvec_key_not_found);
+  for (int i = 0; i < 10; ++i) {
+    cvector_push_back(cvec, &i);
+  }
+
+  int val;
+  REQUIRE_EQ(cvector_swap_remove(cvec, 2, &val), cvec_success);
+  REQUIRE_EQ(val, 2);
+  REQUIRE_EQ(cvector_swap_remove(cvec, 8, NULL), cvec_success);
+  int after_removes[] = {0, 1, 9, 3, 4, 5, 6, 7};
+  REQUIRE_EQ(cvector_elem_count64(cvec), 8);
+  for (int i = 0; i < 8; ++i) {
+    cvector_get_copy_at(cvec, i, &val);
+    REQUIRE_EQ(val, after_removes[i]);
+  }
+
+  uint64_t unsorted[] = {3, 1};
+  uint64_t out_of_range[] = {1, 8};
+  REQUIRE_EQ(cvector_swap_remove_n(cvec, unsorted, 2), cvec_invalid_arguments);
+  REQUIRE_EQ(cvector_swap_remove_n(cvec, out_of_range, 2), cvec_key_not_found);
+  REQUIRE_EQ(cvector_elem_count64(cvec), 8);
+
+  // The last two elements are among the removed ones.
+  uint64_t indexes[] = {0, 2, 6, 7};
+  REQUIRE_EQ(cvector_swap_remove_n(cvec, indexes, 4), cvec_success);
+  int after_batch[] = {4, 1, 5, 3};
+  REQUIRE_EQ(cvector_elem_count64(cvec), 4);
+  for (int i = 0; i < 4; ++i) {
+    cvector_get_copy_at(cvec, i, &val);
+    REQUIRE_EQ(val, after_batch[i]);
+  }
+  cvector_destroy(cvec);
+
+  // Removing most of a large vector in one batch shrinks it in one go.
+  cvec = cvector_create(sizeof(int), NULL);
+  uint64_t* all_but_first = malloc(99990 * sizeof(uint64_t));
+  for (int i = 0; i < 100000; ++i) {
+    cvector_push_back(cvec, &i);
+    if (i >= 10) {
+      all_but_first[i - 10] = i;
+    }
+  }
+  REQUIRE_EQ(cvector_swap_remove_n(cvec, all_but_first, 99990), cvec_success);
+  free(all_but_first);
+  REQUIRE_EQ(cvector_elem_count64(cvec), 10);
+  REQUIRE_LE(cvector_capacity64(cvec), 64);
+  for (int i = 0; i < 10; ++i) {
+    cvector_get_copy_at(cvec, i, &val);
+    REQUIRE_EQ(val, i);
+  }
+  cvector_destroy(cvec);
+}
+
+static long live_allocations = 0;
+
+static void* counting_malloc(size_t size) {
+  ++live_allocations;
+  return malloc(size);
+}
+
+static void* counting_calloc(size_t elem_count, size_t elem_size) {
+  ++live_allocations;
+  return calloc(elem_count, elem_size);
+}
+
+static void* counting_realloc(void* ptr, size_t size) {
+  live_allocations += !ptr;
+  return realloc(ptr, size);
+}
+
+static void counting_free(void* ptr) {
+  live_allocations -= !!ptr;
+  free(ptr);
+}
+
+static cvector_memmgmt_procs_t counting_procs = {.malloc = counting_malloc,
+                                                 .free = counting_free,
+                                                 .calloc = counting_calloc,
+                                                 .realloc = counting_realloc};
+
+TEST(cvectors, inline_storage) {
+  // Less than one element of inline storage is ignored.
+  cvector* cvec = cvector_create_opts(
+      sizeof(int),
+      &(cvector_create_opts_t){.mmgmt_procs = &counting_procs,
+                               .inline_bytes = sizeof(int) - 1},
+      NULL);
+  REQUIRE_EQ(live_allocations, 2);
+  cvector_destroy(cvec);
+  REQUIRE_EQ(live_allocations, 0);
+
+  // The vector is the only allocation until the ninth element spills over
+  // to the heap.
+  cvec = cvector_create_opts(
+      sizeof(int),
+      &(cvector_create_opts_t){.mmgmt_procs = &counting_procs,
+                               .inline_bytes = 8 * sizeof(int)},
+      NULL);
+  REQUIRE_EQ(live_allocations, 1);
+  REQUIRE_EQ(cvector_capacity64(cvec), 8);
+  for (int i = 0; i < 8; ++i) {
+    REQUIRE_EQ(cvector_push_back(cvec, &i), cvec_success);
+  }
+  REQUIRE_EQ(live_allocations, 1);
+  REQUIRE_EQ(cvector_capacity64(cvec), 8);
+
+  int val = 8;
+  REQUIRE_EQ(cvector_push_back(cvec, &val), cvec_success);
+  REQUIRE_EQ(live_allocations, 2);
+  REQUIRE_GT(cvector_capacity64(cvec), 8);
+  for (int i = 0; i < 9; ++i) {
+    cvector_get_copy_at(cvec, i, &val);
+    REQUIRE_EQ(val, i);
+  }
+
+  // Shrinking moves the elements back into the inline buffer.
+  while (cvector_elem_count64(cvec) > 2) {
+    cvector_pop_back(cvec, &val);
+  }
+  REQUIRE_EQ(live_allocations, 1);
+  REQUIRE_EQ(cvector_capacity64(cvec), 8);
+  for (int i = 0; i < 2; ++i) {
+    cvector_get_copy_at(cvec, i, &val);
+    REQUIRE_EQ(val, i);
+  }
+
+  int arr[20] = {0};
+  REQUIRE_EQ(cvector_push_back_n(cvec, arr, 20), cvec_success);
+  REQUIRE_EQ(live_allocations, 2);
+  REQUIRE_EQ(cvector_shrink_to_fit(cvec), cvec_success);
+  REQUIRE_EQ(cvector_capacity64(cvec), 22);
+  cvector_reset(cvec);
+  REQUIRE_EQ(live_allocations, 1);
+  REQUIRE_EQ(cvector_capacity64(cvec), 8);
+
+  cvector_destroy(cvec);
+  REQUIRE_EQ(live_allocations, 0);
+
+  cvec = cvector_create_opts(
+      sizeof(int),
+      &(cvector_create_opts_t){.mmgmt_procs = &counting_procs,
+                               .single_allocation = true},
+      NULL);
+  REQUIRE_EQ(live_allocations, 1);
+  REQUIRE_EQ(cvector_capacity64(cvec), 4);
+  cvector_destroy(cvec);
+  REQUIRE_EQ(live_allocations, 0);
+}
+
+typedef struct connection_table {
+  int id;
+  cvector_storage connections;
+  cvector_storage timeouts;
+} connection_table;
+
+TEST(cvectors, embedded_vectors) {
+  char* err = NULL;
+  cvector_storage storage;
+  REQUIRE(!cvector_init(NULL, sizeof(int), NULL, &err));
+  REQUIRE(err);
+  REQUIRE(!cvector_init(&storage, 0, NULL, &err));
+  REQUIRE(!cvector_init(&storage, sizeof(int),
+                        &(cvector_create_opts_t){.inline_bytes = 64}, &err));
+
+  // The headers live in the table, only the data containers are allocated.
+  connection_table table = {.id = 42};
+  cvector* connections =
+      cvector_init(&table.connections, sizeof(int),
+                   &(cvector_create_opts_t){.mmgmt_procs = &counting_procs},
+                   &err);
+  REQUIRE(connections);
+  REQUIRE(!err);
+  cvector* timeouts = cvector_init(&table.timeouts, sizeof(double), NULL, NULL);
+  REQUIRE(timeouts);
+  REQUIRE_EQ(live_allocations, 1);
+
+  for (int i = 0; i < 100; ++i) {
+    REQUIRE_EQ(cvector_push_back(connections, &i), cvec_success);
+    REQUIRE_EQ(cvector_push_back(timeouts, &(double){i * 0.5}), cvec_success);
+  }
+  REQUIRE_EQ(cvector_erase_range(connections, 0, 50), cvec_success);
+  int64_t sum = 0;
+  REQUIRE_EQ(cvector_sum_i32(connections, &sum), cvec_success);
+  REQUIRE_EQ(sum, 3725);
+  REQUIRE_EQ(cvector_elem_count64(timeouts), 100);
+  REQUIRE_EQ(table.id, 42);
+
+  // Destroying an embedded vector releases its data but not the storage.
+  cvector_destroy(connections);
+  REQUIRE_EQ(live_allocations, 0);
+  cvector_deinit(timeouts);
+
+  cvector_storage pool[4];
+  for (int i = 0; i < 4; ++i) {
+    cvector* v = cvector_init(&pool[i], sizeof(int), NULL, NULL);
+    REQUIRE_EQ(cvector_push_back(v, &i), cvec_success);
+  }
+  for (int i = 0; i < 4; ++i) {
+    int val;
+    REQUIRE_EQ(cvector_pop_back((cvector*)&pool[i], &val), cvec_success);
+    REQUIRE_EQ(val, i);
+    cvector_deinit((cvector*)&pool[i]);
+  }
+}
+
+// Records each block size in front of the block, to check that the
+// library hands the context procedures back the sizes it allocated with.
+typedef struct size_checker {
+  long live_blocks;
+  long size_mismatches;
+} size_checker;
+
+static void* checked_malloc(void* ctx, size_t size) {
+  size_t* block = malloc(sizeof(max_align_t) + size);
+  *block = size;
+  ++((size_checker*)ctx)->live_blocks;
+  return (char*)block + sizeof(max_align_t);
+}
+
+static void checked_free(void* ctx, void* ptr, size_t size) {
+  size_t* block = (size_t*)((char*)ptr - sizeof(max_align_t));
+  ((size_checker*)ctx)->size_mismatches += *block != size;
+  --((size_checker*)ctx)->live_blocks;
+  free(block);
+}
+
+static void* checked_realloc(void* ctx, void* ptr, size_t old_size,
+                             size_t new_size) {
+  void* new_ptr = checked_malloc(ctx, new_size);
+  if (ptr) {
+    memcpy(new_ptr, ptr, old_size < new_size ? old_size : new_size);
+    checked_free(ctx, ptr, old_size);
+  }
+  return new_ptr;
+}
+
+static void fill_and_check(cvector* cvec, int count) {
+  for (int i = 0; i < count; ++i) {
+    REQUIRE_EQ(cvector_push_back(cvec, &i), cvec_success);
+  }
+  for (int i = 0; i < count; ++i) {
+    int val;
+    cvector_get_copy_at(cvec, i, &val);
+    REQUIRE_EQ(val, i);
+  }
+}
+
+TEST(cvectors, context_allocators) {
+  REQUIRE(!cvector_create_mp(
+      sizeof(int),
+      &(cvector_memmgmt_procs_t){.ctx_malloc = checked_malloc,
+                                 .ctx_free = checked_free},
+      NULL));
+
+  size_checker checker = {0};
+  cvector_memmgmt_procs_t checked_procs = {.ctx = &checker,
+                                           .ctx_malloc = checked_malloc,
+                                           .ctx_realloc = checked_realloc,
+                                           .ctx_free = checked_free};
+  cvector* cvec = cvector_create_opts(
+      sizeof(int),
+      &(cvector_create_opts_t){.mmgmt_procs = &checked_procs,
+                               .inline_bytes = 4 * sizeof(int)},
+      NULL);
+  fill_and_check(cvec, 1000);
+  REQUIRE_EQ(cvector_sort_by_key(cvec, 0, 4), cvec_success);
+  REQUIRE_EQ(cvector_erase_range(cvec, 2, 1000), cvec_success);
+  cvector_reset(cvec);
+  fill_and_check(cvec, 100);
+  cvector_destroy(cvec);
+
+  dvec d;
+  REQUIRE_EQ(dvec_init_mp(&d, &checked_procs), cvec_success);
+  for (int i = 0; i < 100; ++i) {
+    REQUIRE_EQ(dvec_push(&d, i), cvec_success);
+  }
+  REQUIRE_EQ(dvec_shrink_to_fit(&d), cvec_success);
+  dvec_destroy(&d);
+  REQUIRE_EQ(checker.live_blocks, 0);
+  REQUIRE_EQ(checker.size_mismatches, 0);
+
+  // Vectors sharing an arena, which gets reused after a reset.
+  cvector_arena* arena = cvector_arena_create(1024, NULL);
+  cvector_memmgmt_procs_t arena_procs = cvector_arena_procs(arena);
+  for (int round = 0; round < 3; ++round) {
+    cvector* a = cvector_create_mp(sizeof(int), &arena_procs, NULL);
+    cvector* b = cvector_create_mp(sizeof(int), &arena_procs, NULL);
+    fill_and_check(a, 500);
+    fill_and_check(b, 3000);
+    cvector_destroy(a);
+    cvector_destroy(b);
+    cvector_arena_reset(arena);
+  }
+  cvector_arena_destroy(arena);
+  REQUIRE(!arena);
+
+  // The pool recycles the blocks of destroyed vectors, the 64KiB data
+  // container of the first round being reused by the following ones.
+  cvector_pool* pool = cvector_pool_create(NULL);
+  cvector_memmgmt_procs_t pool_procs = cvector_pool_procs(pool);
+  void* first_data = NULL;
+  for (int round = 0; round < 3; ++round) {
+    cvector* p = cvector_create_mp(sizeof(int), &pool_procs, NULL);
+    fill_and_check(p, 10000);
+    int* data;
+    cvector_get_ptr_at(p, 0, (void**)&data);
+    if (round == 0) {
+      first_data = data;
+    }
+    REQUIRE_EQ((void*)data, first_data);
+    cvector_destroy(p);
+    cvector* q = cvector_create_mp(sizeof(int), &pool_procs, NULL);
+    fill_and_check(q, 70000);
+    cvector_destroy(q);
+  }
+  cvector_pool_destroy(pool);
+}
+
+TEST(cvectors, mapped_storage) {
+  size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+  size_checker checker = {0};
+  cvector_memmgmt_procs_t checked_procs = {.ctx = &checker,
+                                           .ctx_malloc = checked_malloc,
+                                           .ctx_realloc = checked_realloc,
+                                           .ctx_free = checked_free};
+  cvector* cvec = cvector_create_opts(
+      sizeof(int),
+      &(cvector_create_opts_t){.mmgmt_procs = &checked_procs,
+                               .mmap_threshold = 64 * 1024,
+                               .huge_pages = true},
+      NULL);
+
+  // Past 64KiB the data container is a page aligned mapping, which the
+  // procs never see.
+  fill_and_check(cvec, 200000);
+  int* data;
+  cvector_get_ptr_at(cvec, 0, (void**)&data);
+  REQUIRE_EQ((uintptr_t)data % page_size, 0);
+  REQUIRE_EQ(checker.live_blocks, 1);
+
+  // Popping brings the data back to the heap once it is small enough.
+  int val;
+  while (cvector_elem_count64(cvec) > 100) {
+    cvector_pop_back(cvec, &val);
+  }
+  REQUIRE_EQ(checker.live_blocks, 2);
+  for (int i = 0; i < 100; ++i) {
+    cvector_get_copy_at(cvec, i, &val);
+    REQUIRE_EQ(val, i);
+  }
+
+  int arr[50000] = {0};
+  REQUIRE_EQ(cvector_push_back_n(cvec, arr, 50000), cvec_success);
+  REQUIRE_EQ(checker.live_blocks, 1);
+  REQUIRE_EQ(cvector_shrink_to_fit(cvec), cvec_success);
+  REQUIRE_EQ(cvector_capacity64(cvec), 50100);
+  for (int i = 0; i < 100; ++i) {
+    cvector_get_copy_at(cvec, i, &val);
+    REQUIRE_EQ(val, i);
+  }
+  cvector_destroy(cvec);
+  REQUIRE_EQ(checker.live_blocks, 0);
+  REQUIRE_EQ(checker.size_mismatches, 0);
+
+  // Inline buffers spill directly into a mapping.
+  cvec = cvector_create_opts(
+      sizeof(int),
+      &(cvector_create_opts_t){.inline_bytes = 16, .mmap_threshold = 1},
+      NULL);
+  fill_and_check(cvec, 5000);
+  cvector_reset(cvec);
+  fill_and_check(cvec, 10);
+  cvector_destroy(cvec);
+}
+
+TEST(cvectors, file_backed) {
+  char path[] = "/tmp/cvector_test_XXXXXX";
+  int fd = mkstemp(path);
+  REQUIRE_GE(fd, 0);
+  close(fd);
+
+  char* err = NULL;
+  REQUIRE(!cvector_open_file("/nonexistent/dir/file", sizeof(int), 0, &err));
+  REQUIRE(err);
+  REQUIRE_EQ(cvector_sync(NULL), cvec_invalid_arguments);
+
+  cvector* cvec = cvector_open_file(path, sizeof(int), 0, &err);
+  REQUIRE(cvec);
+  REQUIRE(!err);
+  REQUIRE_EQ(cvector_elem_count64(cvec), 0);
+  fill_and_check(cvec, 100000);
+  REQUIRE_EQ(cvector_sync(cvec), cvec_success);
+  cvector_destroy(cvec);
+
+  // Reopening brings every element back, whether synced or not.
+  cvec = cvector_open_file(path, sizeof(int), 0, NULL);
+  REQUIRE(cvec);
+  REQUIRE_EQ(cvector_elem_count64(cvec), 100000);
+  for (int i = 0; i < 100000; ++i) {
+    int val;
+    cvector_get_copy_at(cvec, i, &val);
+    REQUIRE_EQ(val, i);
+  }
+  int val;
+  while (cvector_elem_count64(cvec) > 10) {
+    cvector_pop_back(cvec, &val);
+  }
+  cvector_destroy(cvec);
+
+  cvec = cvector_open_file(path, sizeof(int), 0, NULL);
+  REQUIRE_EQ(cvector_elem_count64(cvec), 10);
+  cvector_get_copy_at(cvec, 9, &val);
+  REQUIRE_EQ(val, 9);
+  cvector_destroy(cvec);
+
+  REQUIRE(!cvector_open_file(path, sizeof(double), 0, &err));
+  REQUIRE(err);
+
+  // A damaged header is refused.
+  fd = open(path, O_RDWR);
+  REQUIRE_EQ(pwrite(fd, "X", 1, 20), 1);
+  close(fd);
+  REQUIRE(!cvector_open_file(path, sizeof(int), 0, &err));
+  REQUIRE(err);
+
+  cvec = cvector_open_file(path, sizeof(int), cvec_file_truncate, NULL);
+  REQUIRE(cvec);
+  REQUIRE_EQ(cvector_elem_count64(cvec), 0);
+  cvector_destroy(cvec);
+
+  unlink(path);
+  REQUIRE(!cvector_open_file(path, sizeof(int), 0, NULL));
+  cvec = cvector_open_file(path, sizeof(int), cvec_file_create, NULL);
+  REQUIRE(cvec);
+  cvector_destroy(cvec);
+  unlink(path);
+}
+
+TEST(cvectors, fd_serialization) {
+  FILE* tmp = tmpfile();
+  REQUIRE(tmp);
+  int fd = fileno(tmp);
+
+  cvector* cvec = cvector_create(sizeof(int), NULL);
+  REQUIRE_EQ(cvector_write_fd(NULL, fd), cvec_invalid_arguments);
+  REQUIRE_EQ(cvector_write_fd(cvec, -1), cvec_invalid_arguments);
+  fill_and_check(cvec, 100000);
+  REQUIRE_EQ(cvector_write_fd(cvec, fd), cvec_success);
+  REQUIRE_EQ(lseek(fd, 0, SEEK_CUR), 32 + 100000 * sizeof(int));
+
+  // Reading appends to what is already there.
+  cvector* copy = cvector_create(sizeof(int), NULL);
+  int first = -1;
+  cvector_push_back(copy, &first);
+  lseek(fd, 0, SEEK_SET);
+  REQUIRE_EQ(cvector_read_fd(copy, fd), cvec_success);
+  REQUIRE_EQ(cvector_elem_count64(copy), 100001);
+  for (int i = 0; i < 100000; ++i) {
+    int val;
+    cvector_get_copy_at(copy, i + 1, &val);
+    REQUIRE_EQ(val, i);
+  }
+
+  cvector* other = cvector_create(sizeof(double), NULL);
+  lseek(fd, 0, SEEK_SET);
+  REQUIRE_EQ(cvector_read_fd(other, fd), cvec_invalid_arguments);
+  REQUIRE_EQ(cvector_elem_count64(other), 0);
+  cvector_destroy(other);
+
+  // A truncated stream leaves the vector as it was.
+  REQUIRE_EQ(ftruncate(fd, 32 + 100 * sizeof(int) - 1), 0);
+  lseek(fd, 0, SEEK_SET);
+  REQUIRE_EQ(cvector_read_fd(copy, fd), cvec_io_error);
+  REQUIRE_EQ(cvector_elem_count64(copy), 100001);
+
+  // So does a damaged header.
+  REQUIRE_EQ(pwrite(fd, "X", 1, 0), 1);
+  lseek(fd, 0, SEEK_SET);
+  REQUIRE_EQ(cvector_read_fd(copy, fd), cvec_io_error);
+  REQUIRE_EQ(cvector_elem_count64(copy), 100001);
+  cvector_destroy(copy);
+
+  // Empty vectors round-trip too.
+  REQUIRE_EQ(ftruncate(fd, 0), 0);
+  lseek(fd, 0, SEEK_SET);
+  cvector_destroy(cvec);
+  cvec = cvector_create(sizeof(int), NULL);
+  REQUIRE_EQ(cvector_write_fd(cvec, fd), cvec_success);
+  lseek(fd, 0, SEEK_SET);
+  REQUIRE_EQ(cvector_read_fd(cvec, fd), cvec_success);
+  REQUIRE_EQ(cvector_elem_count64(cvec), 0);
+  REQUIRE_EQ(cvector_read_fd(cvec, fd), cvec_io_error);
+  cvector_destroy(cvec);
+  fclose(tmp);
+}
+
+#define producer_count 4
+#define pushes_per_producer 50000
+
+typedef struct producer_args {
+  cvector_concurrent* cvec;
+  uint64_t id;
+} producer_args;
+
+static void* push_tagged_values(void* arg) {
+  producer_args* args = arg;
+  for (uint64_t i = 0; i < pushes_per_producer; ++i) {
+    uint64_t val = args->id << 32 | i;
+    if (i % 3 == 0) {
+      uint64_t vals[2] = {val, val + 1};
+      cvector_concurrent_push_back_n(args->cvec, vals, 2, NULL);
+      ++i;
+    } else {
+      cvector_concurrent_push_back(args->cvec, &val, NULL);
+    }
+  }
+  return NULL;
+}
+
+static void sum_elems(uint64_t index, void* elem, void* args) {
+  (void)index;
+  *(uint64_t*)args += *(uint64_t*)elem & 0xffffffff;
+}
+
+TEST(cvectors, concurrent_append) {
+  char* err = NULL;
+  REQUIRE(!cvector_concurrent_create(0, NULL, &err));
+  REQUIRE(err);
+
+  cvector_concurrent* cvec =
+      cvector_concurrent_create(sizeof(uint64_t), NULL, &err);
+  REQUIRE(cvec);
+  REQUIRE(!err);
+  REQUIRE_EQ(cvector_concurrent_elem_count(cvec), 0);
+  REQUIRE_EQ(cvector_concurrent_push_back(NULL, &err, NULL),
+             cvec_invalid_arguments);
+  void* ptr;
+  REQUIRE_EQ(cvector_concurrent_get_ptr_at(cvec, 0, &ptr),
+             cvec_key_not_found);
+
+  // Runs of elements spanning several segments stay contiguous in index.
+  uint64_t vals[100];
+  for (uint64_t i = 0; i < 100; ++i) {
+    vals[i] = i;
+  }
+  uint64_t index;
+  REQUIRE_EQ(cvector_concurrent_push_back(cvec, &vals[0], &index),
+             cvec_success);
+  REQUIRE_EQ(index, 0);
+  REQUIRE_EQ(cvector_concurrent_get_ptr_at(cvec, 0, &ptr), cvec_success);
+  REQUIRE_EQ(cvector_concurrent_push_back_n(cvec, &vals[1], 99, &index),
+             cvec_success);
+  REQUIRE_EQ(index, 1);
+  REQUIRE_EQ(cvector_concurrent_elem_count(cvec), 100);
+  for (uint64_t i = 0; i < 100; ++i) {
+    uint64_t val;
+    REQUIRE_EQ(cvector_concurrent_get_copy_at(cvec, i, &val), cvec_success);
+    REQUIRE_EQ(val, i);
+  }
+
+  // Runs that can never fit claim nothing, the next ones follow on.
+  REQUIRE_EQ(cvector_concurrent_push_back_n(cvec, vals, UINT64_MAX, NULL),
+             cvec_not_enough_memory);
+  REQUIRE_EQ(cvector_concurrent_push_back_n(cvec, vals, UINT64_MAX - 100,
+                                            NULL),
+             cvec_not_enough_memory);
+  REQUIRE_EQ(cvector_concurrent_push_back(cvec, &vals[0], &index),
+             cvec_success);
+  REQUIRE_EQ(index, 100);
+  REQUIRE_EQ(cvector_concurrent_elem_count(cvec), 101);
+
+  // Growth never moves what is already there.
+  REQUIRE_EQ(cvector_concurrent_reserve(cvec, 100000), cvec_success);
+  void* same;
+  cvector_concurrent_get_ptr_at(cvec, 0, &same);
+  REQUIRE_EQ(ptr, same);
+  cvector_concurrent_destroy(cvec);
+  REQUIRE(!cvec);
+
+  // The header comes from the procs as well.
+  size_checker checker = {0};
+  cvector_memmgmt_procs_t checked_procs = {.ctx = &checker,
+                                           .ctx_malloc = checked_malloc,
+                                           .ctx_realloc = checked_realloc,
+                                           .ctx_free = checked_free};
+  cvec = cvector_concurrent_create(sizeof(uint64_t), &checked_procs, NULL);
+  REQUIRE_EQ(checker.live_blocks, 1);
+  REQUIRE_EQ(cvector_concurrent_push_back_n(cvec, vals, 100, NULL),
+             cvec_success);
+  cvector_concurrent_destroy(cvec);
+  REQUIRE_EQ(checker.live_blocks, 0);
+  REQUIRE_EQ(checker.size_mismatches, 0);
+
+  cvec = cvector_concurrent_create(sizeof(uint64_t), NULL, NULL);
+  pthread_t threads[producer_count];
+  producer_args args[producer_count];
+  for (uint64_t t = 0; t < producer_count; ++t) {
+    args[t] = (producer_args){.cvec = cvec, .id = t};
+    REQUIRE_EQ(pthread_create(&threads[t], NULL, push_tagged_values,
+                              &args[t]),
+               0);
+  }
+  for (uint64_t t = 0; t < producer_count; ++t) {
+    pthread_join(threads[t], NULL);
+  }
+
+  // Every value is there once, in the order its producer pushed it.
+  REQUIRE_EQ(cvector_concurrent_elem_count(cvec),
+             producer_count * pushes_per_producer);
+  uint64_t next[producer_count] = {0};
+  for (uint64_t i = 0; i < producer_count * pushes_per_producer; ++i) {
+    uint64_t val;
+    cvector_concurrent_get_copy_at(cvec, i, &val);
+    uint64_t id = val >> 32;
+    REQUIRE_LT(id, producer_count);
+    REQUIRE_EQ(val & 0xffffffff, next[id]);
+    ++next[id];
+  }
+
+  uint64_t sum = 0;
+  cvector_concurrent_exec_for_each(cvec, sum_elems, &sum);
+  REQUIRE_EQ(sum, producer_count * (uint64_t)pushes_per_producer *
+                      (pushes_per_producer - 1) / 2);
+  cvector_concurrent_destroy(cvec);
+}
+
+static void check_index(uint64_t index, void* elem, void* args) {
+  if (*(uint64_t*)elem != index) {
+    ++*(uint64_t*)args;
+  }
+}
+
+TEST(cvectors, segmented_vector) {
+  char* err = NULL;
+  REQUIRE(!cvector_segmented_create(0, NULL, &err));
+  REQUIRE(err);
+
+  cvector_segmented* cvec =
+      cvector_segmented_create(sizeof(uint64_t), NULL, &err);
+  REQUIRE(cvec);
+  REQUIRE(!err);
+  uint64_t val = 0;
+  void* first;
+  REQUIRE_EQ(cvector_segmented_pop_back(cvec, &val), cvec_empty);
+  REQUIRE_EQ(cvector_segmented_get_ptr_at(cvec, 0, &first),
+             cvec_key_not_found);
+  REQUIRE_EQ(cvector_segmented_push_back(cvec, NULL), cvec_invalid_arguments);
+  REQUIRE_EQ(cvector_segmented_capacity(cvec), 0);
+
+  REQUIRE_EQ(cvector_segmented_push_back(cvec, &val), cvec_success);
+  REQUIRE_EQ(cvector_segmented_get_ptr_at(cvec, 0, &first), cvec_success);
+  for (val = 1; val < 100000; ++val) {
+    REQUIRE_EQ(cvector_segmented_push_back(cvec, &val), cvec_success);
+  }
+
+  // Growth left the first element where it was.
+  void* ptr;
+  cvector_segmented_get_ptr_at(cvec, 0, &ptr);
+  REQUIRE_EQ(ptr, first);
+  REQUIRE_EQ(*(uint64_t*)first, 0);
+
+  uint64_t vals[1000];
+  for (uint64_t i = 0; i < 1000; ++i) {
+    vals[i] = 100000 + i;
+  }
+  REQUIRE_EQ(cvector_segmented_push_back_n(cvec, vals, 1000), cvec_success);
+  REQUIRE_EQ(cvector_segmented_elem_count(cvec), 101000);
+  REQUIRE_GE(cvector_segmented_capacity(cvec), 101000);
+  for (uint64_t i = 0; i < 101000; i += 7) {
+    REQUIRE_EQ(cvector_segmented_get_copy_at(cvec, i, &val), cvec_success);
+    REQUIRE_EQ(val, i);
+  }
+  uint64_t mismatches = 0;
+  cvector_segmented_exec_for_each(cvec, check_index, &mismatches);
+  REQUIRE_EQ(mismatches, 0);
+
+  for (uint64_t i = 101000; i > 10; --i) {
+    REQUIRE_EQ(cvector_segmented_pop_back(cvec, &val), cvec_success);
+    REQUIRE_EQ(val, i - 1);
+  }
+  REQUIRE_EQ(cvector_segmented_get_copy_at(cvec, 10, &val),
+             cvec_key_not_found);
+  REQUIRE_EQ(cvector_segmented_shrink_to_fit(cvec), cvec_success);
+  REQUIRE_EQ(cvector_segmented_capacity(cvec), 16);
+  cvector_segmented_get_ptr_at(cvec, 0, &ptr);
+  REQUIRE_EQ(ptr, first);
+
+  REQUIRE_EQ(cvector_segmented_reserve(cvec, 1000), cvec_success);
+  REQUIRE_GE(cvector_segmented_capacity(cvec), 1000);
+  REQUIRE_EQ(cvector_segmented_reserve(cvec, UINT64_MAX),
+             cvec_not_enough_memory);
+  cvector_segmented_destroy(cvec);
+  REQUIRE(!cvec);
+
+  // The header comes from the procs as well.
+  size_checker checker = {0};
+  cvector_memmgmt_procs_t checked_procs = {.ctx = &checker,
+                                           .ctx_malloc = checked_malloc,
+                                           .ctx_realloc = checked_realloc,
+                                           .ctx_free = checked_free};
+  cvec = cvector_segmented_create(sizeof(uint64_t), &checked_procs, NULL);
+  REQUIRE_EQ(checker.live_blocks, 1);
+  for (uint64_t i = 0; i < 1000; ++i) {
+    REQUIRE_EQ(cvector_segmented_push_back(cvec, &i), cvec_success);
+  }
+  cvector_segmented_destroy(cvec);
+  REQUIRE_EQ(checker.live_blocks, 0);
+  REQUIRE_EQ(checker.size_mismatches, 0);
+}
+
+typedef struct snapshot_reader_args {
+  cvector* cvec;
+  atomic_bool* done;
+  uint64_t errors;
+} snapshot_reader_args;
+
+static void check_snapshot_elem(uint64_t index, const void* elem,
+                                void* args) {
+  if (*(const uint64_t*)elem != index) {
+    ++*(uint64_t*)args;
+  }
+}
+
+static void* scan_snapshots(void* arg) {
+  snapshot_reader_args* args = arg;
+  uint64_t last_count = 0;
+  while (!atomic_load(args->done)) {
+    cvector_snapshot snapshot;
+    if (cvector_snapshot_begin(args->cvec, &snapshot) != cvec_success) {
+      ++args->errors;
+      break;
+    }
+    if (snapshot.elem_count < last_count) {
+      ++args->errors;
+    }
+    last_count = snapshot.elem_count;
+    for (uint64_t i = 0; i < snapshot.elem_count; ++i) {
+      if (((const uint64_t*)snapshot.data)[i] != i) {
+        ++args->errors;
+      }
+    }
+    cvector_snapshot_end(args->cvec, &snapshot);
+  }
+  return NULL;
+}
+
+TEST(cvectors, snapshot_reads) {
+  char* err = NULL;
+  REQUIRE(!cvector_create_opts(
+      sizeof(uint64_t),
+      &(cvector_create_opts_t){.snapshot_reads = true, .inline_bytes = 64},
+      &err));
+  REQUIRE(err);
+
+  cvector_snapshot snapshot;
+  cvector* plain = cvector_create(sizeof(uint64_t), NULL);
+  REQUIRE_EQ(cvector_snapshot_begin(plain, &snapshot),
+             cvec_invalid_arguments);
+  cvector_destroy(plain);
+
+  cvector_create_opts_t opts = {.snapshot_reads = true};
+  cvector* cvec = cvector_create_opts(sizeof(uint64_t), &opts, &err);
+  REQUIRE(cvec);
+  REQUIRE(!err);
+  for (uint64_t i = 0; i < 10; ++i) {
+    cvector_push_back(cvec, &i);
+  }
+
+  // A snapshot keeps its buffer across growth and shrinking.
+  REQUIRE_EQ(cvector_snapshot_begin(cvec, &snapshot), cvec_success);
+  REQUIRE_EQ(snapshot.elem_count, 10);
+  for (uint64_t i = 10; i < 10000; ++i) {
+    cvector_push_back(cvec, &i);
+  }
+  uint64_t val;
+  while (cvector_elem_count64(cvec) > 5) {
+    cvector_pop_back(cvec, &val);
+  }
+  REQUIRE_EQ(cvector_snapshot_reclaim(cvec), cvec_success);
+  for (uint64_t i = 0; i < 10; ++i) {
+    REQUIRE_EQ(((const uint64_t*)snapshot.data)[i], i);
+  }
+  cvector_snapshot_end(cvec, &snapshot);
+  REQUIRE_EQ(cvector_snapshot_reclaim(cvec), cvec_success);
+
+  REQUIRE_EQ(cvector_snapshot_begin(cvec, &snapshot), cvec_success);
+  REQUIRE_EQ(snapshot.elem_count, 5);
+  cvector_snapshot_end(cvec, &snapshot);
+
+  cvector_snapshot open[CVEC_SNAPSHOT_READERS];
+  for (uint32_t i = 0; i < CVEC_SNAPSHOT_READERS; ++i) {
+    REQUIRE_EQ(cvector_snapshot_begin(cvec, &open[i]), cvec_success);
+  }
+  REQUIRE_EQ(cvector_snapshot_begin(cvec, &snapshot), cvec_not_enough_memory);
+  for (uint32_t i = 0; i < CVEC_SNAPSHOT_READERS; ++i) {
+    cvector_snapshot_end(cvec, &open[i]);
+  }
+  cvector_destroy(cvec);
+
+  // Readers scanning while the writer appends always see written elements.
+  cvec = cvector_create_opts(sizeof(uint64_t), &opts, NULL);
+  atomic_bool done = false;
+  pthread_t threads[2];
+  snapshot_reader_args args[2];
+  for (int t = 0; t < 2; ++t) {
+    args[t] = (snapshot_reader_args){.cvec = cvec, .done = &done};
+    REQUIRE_EQ(pthread_create(&threads[t], NULL, scan_snapshots, &args[t]),
+               0);
+  }
+  for (uint64_t i = 0; i < 200000; ++i) {
+    cvector_push_back(cvec, &i);
+  }
+  atomic_store(&done, true);
+  for (int t = 0; t < 2; ++t) {
+    pthread_join(threads[t], NULL);
+    REQUIRE_EQ(args[t].errors, 0);
+  }
+
+  uint64_t errors = 0;
+  REQUIRE_EQ(cvector_snapshot_exec_for_each(cvec, check_snapshot_elem,
+                                            &errors),
+             cvec_success);
+  REQUIRE_EQ(errors, 0);
+  cvector_destroy(cvec);
+
+  // The reader slots come from the procs, like the data containers.
+  size_checker checker = {0};
+  cvector_memmgmt_procs_t checked_procs = {.ctx = &checker,
+                                           .ctx_malloc = checked_malloc,
+                                           .ctx_realloc = checked_realloc,
+                                           .ctx_free = checked_free};
+  cvec = cvector_create_opts(
+      sizeof(uint64_t),
+      &(cvector_create_opts_t){.mmgmt_procs = &checked_procs,
+                               .snapshot_reads = true},
+      NULL);
+  REQUIRE_EQ(checker.live_blocks, 3);
+  for (uint64_t i = 0; i < 1000; ++i) {
+    cvector_push_back(cvec, &i);
+  }
+  cvector_destroy(cvec);
+  REQUIRE_EQ(checker.live_blocks, 0);
+  REQUIRE_EQ(checker.size_mismatches, 0);
+}
+
+TEST(cvectors, deque_mode) {
+  char* err = NULL;
+  REQUIRE(!cvector_create_opts(
+      sizeof(int), &(cvector_create_opts_t){.deque = true, .inline_bytes = 64},
+      &err));
+  REQUIRE(err);
+
+  int val = 1;
+  cvector* plain = cvector_create(sizeof(int), NULL);
+  REQUIRE_EQ(cvector_push_front(plain, &val), cvec_invalid_arguments);
+  REQUIRE_EQ(cvector_pop_front(plain, &val), cvec_invalid_arguments);
+  cvector_destroy(plain);
+
+  cvector_create_opts_t opts = {.deque = true};
+  cvector* cvec = cvector_create_opts(sizeof(int), &opts, &err);
+  REQUIRE(cvec);
+  REQUIRE(!err);
+  REQUIRE_EQ(cvector_pop_front(cvec, &val), cvec_empty);
+
+  // Builds -1000..999 from both ends, wrapping around and growing the ring.
+  for (int i = 0; i < 1000; ++i) {
+    int front = -i - 1;
+    REQUIRE_EQ(cvector_push_back(cvec, &i), cvec_success);
+    REQUIRE_EQ(cvector_push_front(cvec, &front), cvec_success);
+  }
+  REQUIRE_EQ(cvector_elem_count64(cvec), 2000);
+  uint64_t capacity = cvector_capacity64(cvec);
+  REQUIRE_EQ(capacity & (capacity - 1), 0);
+  for (int i = 0; i < 2000; ++i) {
+    REQUIRE_EQ(cvector_get_copy_at(cvec, i, &val), cvec_success);
+    REQUIRE_EQ(val, i - 1000);
+  }
+
+  // Used as a FIFO queue, the ring keeps its size.
+  for (int i = 0; i < 100000; ++i) {
+    int pushed = 1000 + i;
+    REQUIRE_EQ(cvector_push_back(cvec, &pushed), cvec_success);
+    REQUIRE_EQ(cvector_pop_front(cvec, &val), cvec_success);
+    REQUIRE_EQ(val, i - 1000);
+  }
+  REQUIRE_EQ(cvector_capacity64(cvec), capacity);
+  REQUIRE_EQ(cvector_pop_back(cvec, &val), cvec_success);
+  REQUIRE_EQ(val, 100999);
+
+  // Runs pushed at once and contiguous operations see logical order.
+  int vals[3] = {7, 8, 9};
+  REQUIRE_EQ(cvector_push_back_n(cvec, vals, 3), cvec_success);
+  REQUIRE_EQ(cvector_get_copy_at(cvec, 2001, &val), cvec_success);
+  REQUIRE_EQ(val, 9);
+  for (int i = 0; i < 3; ++i) {
+    cvector_pop_back(cvec, &val);
+  }
+  int64_t sum = 0;
+  REQUIRE_EQ(cvector_sum_i32(cvec, &sum), cvec_success);
+  REQUIRE_EQ(sum, (int64_t)(99000 + 100998) * 1999 / 2);
+  int first = 0;
+  cvector_get_copy_at(cvec, 0, &first);
+  REQUIRE_EQ(first, 99000);
+
+  for (int i = 0; i < 500; ++i) {
+    int front = i;
+    cvector_push_front(cvec, &front);
+  }
+  REQUIRE_EQ(cvector_sort(cvec, compare_ints), cvec_success);
+  for (uint64_t i = 1; i < cvector_elem_count64(cvec); ++i) {
+    int prev;
+    cvector_get_copy_at64(cvec, i - 1, &prev);
+    cvector_get_copy_at64(cvec, i, &val);
+    REQUIRE_LE(prev, val);
+  }
+  REQUIRE_EQ(cvector_push_front(cvec, &first), cvec_success);
+  REQUIRE_EQ(cvector_erase_range(cvec, 0, 1), cvec_success);
+  cvector_get_copy_at(cvec, 0, &val);
+  REQUIRE_EQ(val, 0);
+
+  // Draining it shrinks the ring back.
+  while (cvector_pop_front(cvec, &val) == cvec_success) {
+  }
+  REQUIRE_EQ(cvector_elem_count64(cvec), 0);
+  REQUIRE_LT(cvector_capacity64(cvec), capacity);
+  cvector_destroy(cvec);
+}
+
+#define queue_thread_count 2
+#define messages_per_thread 100000
+
+typedef struct queue_thread_args {
+  cvector_spsc_queue* spsc;
+  cvector_mpmc_queue* mpmc;
+  atomic_uint_fast64_t* remaining;
+  uint64_t id;
+  uint64_t sum;
+  bool in_order;
+} queue_thread_args;
+
+static void* enqueue_tagged_values(void* arg) {
+  queue_thread_args* args = arg;
+  uint64_t vals[7];
+  for (uint64_t i = 0; i < messages_per_thread;) {
+    uint64_t count = i % 7 + 1;
+    if (count > messages_per_thread - i) {
+      count = messages_per_thread - i;
+    }
+    for (uint64_t j = 0; j < count; ++j) {
+      vals[j] = args->id << 32 | (i + j);
+    }
+    uint64_t enqueued = 0;
+    cvector_retval_t result =
+        args->spsc
+            ? cvector_spsc_queue_enqueue_n(args->spsc, vals, count, &enqueued)
+            : cvector_mpmc_queue_enqueue_n(args->mpmc, vals, count,
+                                           &enqueued);
+    if (result == cvec_full) {
+      sched_yield();
+    }
+    i += enqueued;
+  }
+  return NULL;
+}
+
+// Checks that the values of each producer come out in the order they went
+// in, and sums them.
+static void* dequeue_tagged_values(void* arg) {
+  queue_thread_args* args = arg;
+  uint64_t next[queue_thread_count] = {0};
+  uint64_t vals[5];
+  args->in_order = true;
+  while (atomic_load(args->remaining) > 0) {
+    uint64_t dequeued = 0;
+    cvector_retval_t result =
+        args->spsc ? cvector_spsc_queue_dequeue_n(args->spsc, vals, 5,
+                                                  &dequeued)
+                   : cvector_mpmc_queue_dequeue_n(args->mpmc, vals, 5,
+                                                  &dequeued);
+    if (result == cvec_empty) {
+      sched_yield();
+    }
+    for (uint64_t i = 0; i < dequeued; ++i) {
+      uint64_t id = vals[i] >> 32;
+      uint64_t seq = vals[i] & 0xffffffff;
+      args->in_order &= seq >= next[id];
+      next[id] = seq + 1;
+      args->sum += seq;
+    }
+    atomic_fetch_sub(args->remaining, dequeued);
+  }
+  return NULL;
+}
+
+TEST(cvectors, bounded_queues) {
+  char* err = NULL;
+  REQUIRE(!cvector_spsc_queue_create(0, 8, NULL, &err));
+  REQUIRE(err);
+  REQUIRE(!cvector_mpmc_queue_create(sizeof(int), 0, NULL, &err));
+  REQUIRE(err);
+
+  cvector_spsc_queue* spsc =
+      cvector_spsc_queue_create(sizeof(int), 5, NULL, &err);
+  cvector_mpmc_queue* mpmc =
+      cvector_mpmc_queue_create(sizeof(int), 5, NULL, &err);
+  REQUIRE(spsc);
+  REQUIRE(mpmc);
+  REQUIRE(!err);
+  REQUIRE_EQ(cvector_spsc_queue_capacity(spsc), 8);
+  REQUIRE_EQ(cvector_mpmc_queue_capacity(mpmc), 8);
+
+  int val;
+  REQUIRE_EQ(cvector_spsc_queue_dequeue(spsc, &val), cvec_empty);
+  REQUIRE_EQ(cvector_mpmc_queue_dequeue(mpmc, &val), cvec_empty);
+
+  // Batches wrap around the rings and stop at their ends.
+  int vals[10] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9};
+  int out[10];
+  uint64_t moved;
+  for (int lap = 0; lap < 3; ++lap) {
+    REQUIRE_EQ(cvector_spsc_queue_enqueue_n(spsc, vals, 10, &moved),
+               cvec_success);
+    REQUIRE_EQ(moved, 8);
+    REQUIRE_EQ(cvector_mpmc_queue_enqueue_n(mpmc, vals, 10, &moved),
+               cvec_success);
+    REQUIRE_EQ(moved, 8);
+    REQUIRE_EQ(cvector_spsc_queue_enqueue(spsc, &vals[9]), cvec_full);
+    REQUIRE_EQ(cvector_mpmc_queue_enqueue(mpmc, &vals[9]), cvec_full);
+    REQUIRE_EQ(cvector_spsc_queue_elem_count(spsc), 8);
+    REQUIRE_EQ(cvector_mpmc_queue_elem_count(mpmc), 8);
+
+    REQUIRE_EQ(cvector_spsc_queue_dequeue_n(spsc, out, 3, &moved),
+               cvec_success);
+    REQUIRE_EQ(moved, 3);
+    REQUIRE_EQ(cvector_mpmc_queue_dequeue_n(mpmc, out + 3, 3, &moved),
+               cvec_success);
+    REQUIRE_EQ(moved, 3);
+    for (int i = 0; i < 3; ++i) {
+      REQUIRE_EQ(out[i], i);
+      REQUIRE_EQ(out[i + 3], i);
+    }
+
+    REQUIRE_EQ(cvector_spsc_queue_dequeue_n(spsc, out, 10, &moved),
+               cvec_success);
+    REQUIRE_EQ(moved, 5);
+    for (int i = 0; i < 5; ++i) {
+      REQUIRE_EQ(out[i], i + 3);
+    }
+    REQUIRE_EQ(cvector_mpmc_queue_dequeue_n(mpmc, out, 10, &moved),
+               cvec_success);
+    REQUIRE_EQ(moved, 5);
+    for (int i = 0; i < 5; ++i) {
+      REQUIRE_EQ(out[i], i + 3);
+    }
+    REQUIRE_EQ(cvector_spsc_queue_dequeue_n(spsc, out, 10, &moved),
+               cvec_empty);
+    REQUIRE_EQ(moved, 0);
+  }
+  cvector_spsc_queue_destroy(spsc);
+  cvector_mpmc_queue_destroy(mpmc);
+  REQUIRE(!spsc);
+
+  // The headers come from the procs along with the rings.
+  size_checker checker = {0};
+  cvector_memmgmt_procs_t checked_procs = {.ctx = &checker,
+                                           .ctx_malloc = checked_malloc,
+                                           .ctx_realloc = checked_realloc,
+                                           .ctx_free = checked_free};
+  spsc = cvector_spsc_queue_create(sizeof(int), 8, &checked_procs, NULL);
+  mpmc = cvector_mpmc_queue_create(sizeof(int), 8, &checked_procs, NULL);
+  REQUIRE_EQ(checker.live_blocks, 4);
+  cvector_spsc_queue_destroy(spsc);
+  cvector_mpmc_queue_destroy(mpmc);
+  REQUIRE_EQ(checker.live_blocks, 0);
+  REQUIRE_EQ(checker.size_mismatches, 0);
+
+  // Across threads, messages are neither lost nor reordered.
+  uint64_t expected_sum =
+      (uint64_t)messages_per_thread * (messages_per_thread - 1) / 2;
+  atomic_uint_fast64_t remaining = messages_per_thread;
+  spsc = cvector_spsc_queue_create(sizeof(uint64_t), 64, NULL, NULL);
+  queue_thread_args producer = {.spsc = spsc};
+  queue_thread_args consumer = {.spsc = spsc, .remaining = &remaining};
+  pthread_t threads[2 * queue_thread_count];
+  pthread_create(&threads[0], NULL, enqueue_tagged_values, &producer);
+  pthread_create(&threads[1], NULL, dequeue_tagged_values, &consumer);
+  pthread_join(threads[0], NULL);
+  pthread_join(threads[1], NULL);
+  REQUIRE(consumer.in_order);
+  REQUIRE_EQ(consumer.sum, expected_sum);
+  cvector_spsc_queue_destroy(spsc);
+
+  atomic_store(&remaining, messages_per_thread * queue_thread_count);
+  mpmc = cvector_mpmc_queue_create(sizeof(uint64_t), 64, NULL, NULL);
+  queue_thread_args args[2 * queue_thread_count];
+  for (uint64_t i = 0; i < 2 * queue_thread_count; ++i) {
+    args[i] = (queue_thread_args){
+        .mpmc = mpmc, .remaining = &remaining, .id = i};
+    pthread_create(&threads[i], NULL,
+                   i < queue_thread_count ? enqueue_tagged_values
+                                          : dequeue_tagged_values,
+                   &args[i]);
+  }
+  uint64_t sum = 0;
+  for (uint64_t i = 0; i < 2 * queue_thread_count; ++i) {
+    pthread_join(threads[i], NULL);
+    if (i >= queue_thread_count) {
+      REQUIRE(args[i].in_order);
+      sum += args[i].sum;
+    }
+  }
+  REQUIRE_EQ(sum, queue_thread_count * expected_sum);
+  REQUIRE_EQ(cvector_mpmc_queue_elem_count(mpmc), 0);
+  cvector_mpmc_queue_destroy(mpmc);
+}
+
+static int compare_key_to_record(const void* key, const void* elem) {
+  uint32_t k = *(const uint32_t*)key;
+  uint32_t e = ((const record*)elem)->key;
+  return (k > e) - (k < e);
+}
+
+TEST(cvectors, binary_search) {
+  cvector* cvec = cvector_create(sizeof(record), NULL);
+  uint64_t first, last, index;
+  uint32_t key = 0;
+  REQUIRE_EQ(cvector_equal_range(cvec, &key, compare_key_to_record, &first,
+                                 &last),
+             cvec_key_not_found);
+  REQUIRE_EQ(first, 0);
+  REQUIRE_EQ(last, 0);
+  REQUIRE_EQ(cvector_lower_bound_by_key(cvec, 4, 3, 0, &index),
+             cvec_invalid_arguments);
+
+  // Every even key from 0 to 19998 appears three times.
+  const uint64_t count = 30000;
+  for (uint32_t i = 0; i < count; ++i) {
+    record r = {.seq = i, .key = i / 3 * 2};
+    cvector_push_back(cvec, &r);
+  }
+
+  for (key = 0; key <= 20001; ++key) {
+    uint64_t lower = (key + 1) / 2 * 3;
+    if (lower > count) {
+      lower = count;
+    }
+    uint64_t upper = key % 2 == 0 && lower < count ? lower + 3 : lower;
+
+    REQUIRE_EQ(cvector_lower_bound(cvec, &key, compare_key_to_record, &index),
+               cvec_success);
+    REQUIRE_EQ(index, lower);
+    REQUIRE_EQ(cvector_upper_bound(cvec, &key, compare_key_to_record, &index),
+               cvec_success);
+    REQUIRE_EQ(index, upper);
+    REQUIRE_EQ(cvector_equal_range(cvec, &key, compare_key_to_record, &first,
+                                   &last),
+               lower == upper ? cvec_key_not_found : cvec_success);
+    REQUIRE_EQ(first, lower);
+    REQUIRE_EQ(last, upper);
+
+    REQUIRE_EQ(cvector_lower_bound_by_key(cvec, offsetof(record, key), 4, key,
+                                          &index),
+               cvec_success);
+    REQUIRE_EQ(index, lower);
+    REQUIRE_EQ(cvector_upper_bound_by_key(cvec, offsetof(record, key), 4, key,
+                                          &index),
+               cvec_success);
+    REQUIRE_EQ(index, upper);
+    REQUIRE_EQ(cvector_equal_range_by_key(cvec, offsetof(record, key), 4, key,
+                                          &first, &last),
+               lower == upper ? cvec_key_not_found : cvec_success);
+    REQUIRE_EQ(first, lower);
+    REQUIRE_EQ(last, upper);
+  }
+
+  // The last query is out of order and must not reuse the previous answer.
+  uint64_t keys[] = {0, 1, 2, 2, 501, 7000, 7001, 19998, 30000, 4};
+  uint64_t indexes[sizeof(keys) / sizeof(keys[0])];
+  REQUIRE_EQ(cvector_lower_bound_batch_by_key(
+                 cvec, offsetof(record, key), 4, keys,
+                 sizeof(keys) / sizeof(keys[0]), indexes),
+             cvec_success);
+  for (size_t i = 0; i < sizeof(keys) / sizeof(keys[0]); ++i) {
+    uint64_t lower = (keys[i] + 1) / 2 * 3;
+    REQUIRE_EQ(indexes[i], lower > count ? count : lower);
+  }
+
+  cvector_destroy(cvec);
+}
+
 TEST(cvectors, constructive_macros) {
   CVEC_CONSTRUCT(vec, int);
 